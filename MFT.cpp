@@ -34,13 +34,15 @@
 #include "NTFS.h"
 #include "NTFSFile.h"
 #include "NTFSCommon.h"
-#include "RamStream.h"
+#include "ViewStream.h"
 #include "Logger.h"
 #include "SelfDestruct.h"
 
 #include <malloc.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <algorithm>
 
 namespace AccessData
 {
@@ -55,6 +57,7 @@ void CMFT::initfields()
 	m_recsize = 0;
 	m_reccount = 0;
     m_recoverhead = 0;
+	m_reservedvalid = 0;
 }
 
 void CMFT::clearfields()
@@ -66,6 +69,8 @@ void CMFT::clearfields()
 	m_reccount = 0;
 	m_recsize = 0;
     m_recoverhead = 0;
+	m_reserved.clear();
+	m_reservedvalid = 0;
 }
 
 void CMFT::assignfields(const CMFT &rhs)
@@ -76,6 +81,8 @@ void CMFT::assignfields(const CMFT &rhs)
 	m_recsize = rhs.m_recsize;
 	m_reccount = rhs.m_reccount;
     m_recoverhead = rhs.m_recoverhead;
+	m_reserved = rhs.m_reserved;
+	m_reservedvalid = rhs.m_reservedvalid;
 }
 
 CMFT::CMFT()
@@ -99,7 +106,13 @@ void CMFT::clear()
 }
 
 #define MFT_RESERVEDFILERECS 16
+#define MFT_MIRRORFILERECS 4
+#define MFT_BATCHMASKWORDS 8			// batches of up to 256 records need no allocation
 #define MFT_MINRECSIZE 512
+#define MFT_MAXALALENGTH 0x1000000		// sanity limit on an attribute list stream we'll pull into memory
+#define MFT_PREFETCHMAXGAP 16			// unreferenced records we'll read through rather than start another read
+#define MFT_PREFETCHMAXBATCH 256		// records per subrecord prefetch read
+#define MFT_SCANBATCHRECORDS 64			// records per scan() read
 bool CMFT::open(CNTFS *ntfs, CBlockStream *mftstream, int recsize, int physicalblocksize)
 {
 	clear();
@@ -115,6 +128,8 @@ bool CMFT::open(CNTFS *ntfs, CBlockStream *mftstream, int recsize, int physicalb
 
 	m_ntfs = ntfs;
 	m_stream = mftstream;
+	m_stream->SetIOTag(iotagMFT);
+	m_stream->SetAccessHint(iohintMETADATA);
 	m_physicalblocksize = physicalblocksize;
 	m_recsize = recsize;
 	m_reccount = m_stream->Length() / m_recsize;
@@ -146,6 +161,8 @@ bool CMFT::bootstrap(CNTFS *ntfs, SBootRecord *bootrec)
 	// construct a stream by hand
 	CBlockStream *tempstream = new CBlockStream;
 	tempstream->SetDev( m_ntfs );
+	tempstream->SetIOTag( iotagMFT );
+	tempstream->SetAccessHint( iohintMETADATA );
 	tempstream->SetInitialOffset( 0 );
 	tempstream->SetLength( m_recsize * MFT_RESERVEDFILERECS );
 	tempstream->AddRun( bootrec->bpb.ntfs.mftstart, bootrec->bpb.clustersize * bootrec->bpb.ntfs.mftrecordsize * MFT_RESERVEDFILERECS);
@@ -154,6 +171,10 @@ bool CMFT::bootstrap(CNTFS *ntfs, SBootRecord *bootrec)
 	// now we represent a minimal mft.  we can ask for any record number < 16
 	// that also means if we return from here, an isvalid() will show true, so do a clear before returning false
 
+	// pull in the system records once, falling back to $MFTMirr for any that are bad.  They're
+	// served from here from now on, so a damaged $MFT record doesn't stop the mount.
+	if ( !loadreserved(bootrec) ) { TRACELOG0("failed to read the system records"); return false; }
+
 	// read the actual mft from our minimal mft
 	CMFTRecord mftrec;
 	if ( !mftrec.open(m_ntfs, this, MFT_RECNUM(sfrMFT)) ) { TRACELOG0("failed to rec $mft record"); return false; }
@@ -162,6 +183,8 @@ bool CMFT::bootstrap(CNTFS *ntfs, SBootRecord *bootrec)
 	if ( !newmftstream ) { TRACELOG0("failed to open mft attribute stream"); return false; }
 
 	m_stream = newmftstream;
+	m_stream->SetIOTag( iotagMFT );
+	m_stream->SetAccessHint( iohintMETADATA );
 	delete tempstream;
 
 	m_reccount = m_stream->Length() / m_recsize;
@@ -177,6 +200,57 @@ bool CMFT::bootstrap(CNTFS *ntfs, SBootRecord *bootrec)
 	return true;
 }
 
+bool CMFT::loadreserved(SBootRecord *bootrec)
+{
+	m_reserved.resize(MFT_RESERVEDFILERECS * m_recsize);
+	m_reservedvalid = 0;
+
+	// one read for all of them
+	int count = m_stream->Read(&m_reserved[0], MFT_RESERVEDFILERECS * m_recsize, 0) / m_recsize;
+	for(int i = 0; i < count; i++)
+	{
+		SMFTRecord *rec = (SMFTRecord *)&m_reserved[i * m_recsize];
+		if ( rec->isvalid() && rec->dofixup(m_physicalblocksize) ) m_reservedvalid |= 1 << i;
+	}
+
+	// The mirror holds the first cluster's worth of records, at least 4.  Only go there if one of
+	// those is bad, so healthy volumes don't pay for the extra read.
+	int clusterbytes = bootrec->bpb.blocksize * bootrec->bpb.clustersize;
+	int mirrorcount = clusterbytes / m_recsize;
+	if ( mirrorcount < MFT_MIRRORFILERECS ) mirrorcount = MFT_MIRRORFILERECS;
+	if ( mirrorcount > MFT_RESERVEDFILERECS ) mirrorcount = MFT_RESERVEDFILERECS;
+
+	UINT16 mirrormask = (UINT16)((1 << mirrorcount) - 1);
+	if ( (m_reservedvalid & mirrormask) != mirrormask && clusterbytes > 0 )
+	{
+		CBlockStream mirror;
+		mirror.SetDev( m_ntfs );
+		mirror.SetIOTag( iotagMFT );
+		mirror.SetAccessHint( iohintMETADATA );
+		mirror.SetInitialOffset( 0 );
+		mirror.SetLength( mirrorcount * m_recsize );
+		mirror.AddRun( bootrec->bpb.ntfs.mftmirrorstart, div_roundup(mirrorcount * m_recsize, clusterbytes) );
+
+		char *buffer = (char *)malloc(mirrorcount * m_recsize);
+		if ( !buffer ) return false;
+		int mcount = mirror.Read(buffer, mirrorcount * m_recsize, 0) / m_recsize;
+		for(int i = 0; i < mcount; i++)
+		{
+			if ( m_reservedvalid & (1 << i) ) continue;		// the mft's own copy is good, it wins
+
+			SMFTRecord *rec = (SMFTRecord *)(buffer + i * m_recsize);
+			if ( rec->isvalid() && rec->dofixup(m_physicalblocksize) )
+			{
+				TRACELOG0("using the $MFTMirr copy of a system record");
+				memcpy(&m_reserved[i * m_recsize], rec, m_recsize);
+				m_reservedvalid |= 1 << i;
+			}
+		}
+		free(buffer);
+	}
+	return isreserved(sfrMFT);
+}
+
 CMFTRecord*	CMFT::readrecord(MFT_RECNUM recnum)
 {
 	if ( !isvalidrecnum(recnum) ) return NULL;
@@ -188,6 +262,20 @@ CMFTRecord*	CMFT::readrecord(MFT_RECNUM recnum)
     return rec;
 }
 
+bool CMFT::loadrecord(SMFTRecord *rec, MFT_RECNUM recnum)
+{
+	if ( isreserved(recnum.RecNum()) )
+	{
+		memcpy(rec, &m_reserved[recnum.RecNum() * m_recsize], m_recsize);
+		return recnum.isseqwildcard() || rec->sequencenumber == recnum.SeqNum();
+	}
+
+    return	(m_stream->Read(rec, m_recsize, recnum.RecNum() * m_recsize) == m_recsize) &&
+			rec->isvalid() &&
+			rec->dofixup( m_physicalblocksize ) &&
+			( recnum.isseqwildcard() ||  rec->sequencenumber == recnum.SeqNum() );
+}
+
 SMFTRecord*	CMFT::readrawrecord(MFT_RECNUM recnum)
 {
 	if ( !isvalid() || !isvalidrecnum(recnum) ) return NULL;
@@ -195,11 +283,7 @@ SMFTRecord*	CMFT::readrawrecord(MFT_RECNUM recnum)
     SMFTRecord *rec = (SMFTRecord*)malloc(m_recsize);
     if ( !rec ) return NULL;
 
-    bool result = (m_stream->Read(rec, m_recsize, recnum.RecNum() * m_recsize) == m_recsize) &&
-					rec->isvalid() &&
-					rec->dofixup( m_physicalblocksize ) &&
-					( recnum.isseqwildcard() ||  rec->sequencenumber == recnum.SeqNum() );
-    if ( !result )
+    if ( !loadrecord(rec, recnum) )
     {
     	free(rec);
         return NULL;
@@ -207,6 +291,97 @@ SMFTRecord*	CMFT::readrawrecord(MFT_RECNUM recnum)
     return rec;
 }
 
+int CMFT::readrecordbatch(INT64 firstrec, int count, void *dest, bool *valid)
+{
+	if ( !isvalid() || !dest || !valid || firstrec < 0 || firstrec >= m_reccount || count <= 0 ) return 0;
+	if ( firstrec + count > m_reccount ) count = (int)(m_reccount - firstrec);
+
+	int bytesread = m_stream->Read(dest, count * m_recsize, firstrec * m_recsize);
+	if ( bytesread <= 0 ) return 0;
+
+	count = bytesread / m_recsize;
+
+	UINT32 fixedup[MFT_BATCHMASKWORDS];
+	UINT32 *mask = count <= MFT_BATCHMASKWORDS * 32 ? fixedup : (UINT32 *)malloc( ((count + 31) / 32) * sizeof(UINT32) );
+	if ( !mask ) return 0;
+	dofixupbatch(dest, count, m_recsize, m_physicalblocksize, mask);
+
+	for(int i = 0; i < count; i++)
+	{
+		SMFTRecord *rec = (SMFTRecord *)( ((char *)dest) + i * m_recsize );
+		valid[i] = rec->isvalid() && (mask[i / 32] & (1u << (i % 32))) != 0;
+		if ( !valid[i] && isreserved(firstrec + i) )
+		{
+			memcpy(rec, &m_reserved[(firstrec + i) * m_recsize], m_recsize);
+			valid[i] = true;
+		}
+	}
+	if ( mask != fixedup ) free(mask);
+	return count;
+}
+
+bool CMFT::scan(CMFTScanSink &sink, int flags)
+{
+	if ( !isvalid() ) return false;
+
+	char *buffer = (char *)malloc(MFT_SCANBATCHRECORDS * m_recsize);
+	if ( !buffer ) return false;
+	bool valid[MFT_SCANBATCHRECORDS];
+
+	// without the bitmap, fall back to the in use flag in each record
+	CNTFSBitmap *bm = (flags & MFTSCAN_INUSE) ? getbitmap() : NULL;
+	if ( bm && !bm->isvalid() ) { delete bm; bm = NULL; }
+
+	bool stopped = false;
+	for(INT64 first = 0; first < m_reccount && !stopped; first += MFT_SCANBATCHRECORDS)
+	{
+		int count = (int)ad_min( (INT64)MFT_SCANBATCHRECORDS, m_reccount - first );
+
+		// don't bother reading a batch of records that aren't in use
+		bool b;
+		if ( bm && bm->getrun(first, count, b) >= count && !b ) continue;
+
+		int n;
+		{
+			CIOTagScope iotag(iotagMFT, iohintBULK);
+			n = readrecordbatch(first, count, buffer, valid);
+		}
+
+		for(int i = 0; i < count && !stopped; i++)
+		{
+			SMFTRecord *rec = (SMFTRecord *)(buffer + i * m_recsize);
+			if ( i >= n )
+			{
+				if ( flags & MFTSCAN_UNREAD ) stopped = !sink.record(first + i, NULL, m_recsize);
+				continue;
+			}
+			if ( !valid[i] ) continue;
+			if ( (flags & MFTSCAN_INUSE) && (!rec->isinuse() || (bm && !bm->getbit(first + i))) ) continue;
+
+			stopped = !sink.record(first + i, rec, m_recsize);
+		}
+	}
+
+	delete bm;
+	free(buffer);
+	return !stopped;
+}
+
+CSharedBuffer* CMFT::readsharedrecord(MFT_RECNUM recnum)
+{
+	if ( !isvalid() || !isvalidrecnum(recnum) ) return NULL;
+
+	CSharedBuffer *buffer = CSharedBuffer::Create(m_recsize);
+	if ( !buffer ) return NULL;
+
+	if ( !loadrecord((SMFTRecord *)buffer->data(), recnum) )
+	{
+		buffer->Release();
+		return NULL;
+	}
+	return buffer;
+}
+
 int CMFT::freecount()
 {
 	CMFTRecord mftrec;
@@ -214,6 +389,7 @@ int CMFT::freecount()
 
 	CBlockStream *bms = mftrec.openattribute(atBITMAP, L"", -1);
     if ( !bms ) return 0;
+    bms->SetIOTag(iotagBITMAP);
 
     CNTFSBitmap bm;
     bm.open(bms);
@@ -231,6 +407,7 @@ int CMFT::alloccount()
 
 	CBlockStream *bms = mftrec.openattribute(atBITMAP, L"", -1);
     if ( !bms ) return 0;
+    bms->SetIOTag(iotagBITMAP);
 
     CNTFSBitmap bm;
     bm.open(bms);
@@ -248,6 +425,7 @@ CNTFSBitmap* CMFT::getbitmap()
 
 	CBlockStream *bms = mftrec.openattribute(atBITMAP, L"", -1);
 	if ( !bms ) return NULL;
+	bms->SetIOTag(iotagBITMAP);
 
 	CNTFSBitmap *bm = new CNTFSBitmap;
 	bm->open(bms);
@@ -264,6 +442,40 @@ bool CMFT::getrecinfo(MFT_RECNUM recnum, INT64 &startcluster, int &length)
 }
 //-----------------------------------------------------------------------------------
 
+CMFTAttributeIterator::CMFTAttributeIterator(SMFTRecord *rec, int recsize)
+{
+	m_rec = rec;
+	m_recend = ((const char *)rec) + recsize;
+	m_fa = rec->getfirstattribute();
+	m_index = 0;
+	m_complete = false;
+	check();
+}
+
+void CMFTAttributeIterator::next()
+{
+	if ( !m_fa ) return;
+	m_fa = m_rec->getnextattribute(m_fa);
+	m_index++;
+	check();
+}
+
+void CMFTAttributeIterator::check()
+{
+	if ( !m_fa ) return;
+
+	// the type and length have to be there before they can be looked at
+	const char *p = (const char *)m_fa;
+	if ( p + sizeof(INT32) > m_recend ) { m_fa = NULL; return; }
+	if ( m_fa->attributetype == atEND ) { m_fa = NULL; m_complete = true; return; }
+	if ( p + 2 * sizeof(INT32) > m_recend ) { m_fa = NULL; return; }
+
+	// stop at anything that would run off the end of the record
+	if ( m_fa->attributelength == 0 || p + m_fa->attributelength > m_recend ) m_fa = NULL;
+}
+
+//-----------------------------------------------------------------------------------
+
 void CMFTRecord::AttribInfo::clear()
 {
 	attributetype = 0;
@@ -299,25 +511,24 @@ bool CMFTRecord::AttribInfo::read(SMFTAttribute *fa, MFT_RECNUM recnum)
 	return true;
 }
 
-bool CMFTRecord::AttribInfo::read(CStream *fin)
+bool CMFTRecord::AttribInfo::read(const char *ala, int alalength, int &pos)
 {
-	if ( !fin || !fin->isvalid() ) return false;
+	if ( !ala ) return false;
 
 	clear();
 
 	bool isfirst = true;
 
-	void *alrbuffer = alloca( ALArec::MAXRECORDLENGTH );
-	if ( !alrbuffer ) return false;
-
-	while ( true )
+	while ( pos < alalength )
 	{
-		fssize_t pos = fin->Tell();
+		const ALArec *rec = ALArec::get(ala + pos, alalength - pos);
 
-		ALArec *rec = ALArec::read(fin, alrbuffer, ALArec::MAXRECORDLENGTH);
-
-		// if we hit the end of the stream, return success based on if we've read previous records
-		if ( !rec ) return isfirst != true;
+		// a bad entry ends the list; return success based on if we've read previous records
+		if ( !rec )
+		{
+			if ( isfirst ) pos = alalength;
+			break;
+		}
 
 		if ( isfirst )
 		{
@@ -327,18 +538,14 @@ bool CMFTRecord::AttribInfo::read(CStream *fin)
 			isfirst = false;
 		} else
 		{
-			// if the new record doesn't match our first record, rewind the stream to its original position
-			// and return
-			if ( rec->attributetype != attributetype || rec->identifier != identifier || rec->getname() != name )
-			{
-				fin->Seek(pos, CStream::swSET);
-				break; // return true;
-			}
+			// if the new record doesn't match our first record, leave pos on it for the next attribute
+			if ( rec->attributetype != attributetype || rec->identifier != identifier || rec->getname() != name ) break;
 		}
-        fragments.push_back( AttribFragInfo(rec->attributelocation, NULL) );
+		fragments.push_back( AttribFragInfo(rec->attributelocation, NULL) );
+		pos += rec->recordlength;
 	}
 
-	return true;
+	return isfirst != true;
 }
 
 //-------------------------------------------------
@@ -360,7 +567,7 @@ void CMFTRecord::clearfields()
 
 	for(unsigned int i=0; i < m_records.size(); i++)
 	{
-		if ( m_records[i].record ) free(m_records[i].record);
+		if ( m_records[i].buffer ) m_records[i].buffer->Release();
 	}
 	m_records.clear();
 	m_attributes.clear();
@@ -399,9 +606,10 @@ bool CMFTRecord::open(CNTFS *ntfs, CMFT *mft, MFT_RECNUM recnum)
 	m_baserecnum = recnum;
 
 	// Load the base record from the MFT
-	m_baserec = m_mft->readrawrecord( recnum ); // (SMFTRecord*)malloc( m_recsize );
-	if ( !m_baserec ) return false;
-	m_records.push_back( SubRecordInfo(recnum, m_baserec) );	// push it on the vector early so the dtor will take care of cleaning up this pointer
+	CSharedBuffer *basebuffer = m_mft->readsharedrecord( recnum );
+	if ( !basebuffer ) return false;
+	m_records.push_back( SubRecordInfo(recnum, basebuffer) );	// push it on the vector early so the dtor will take care of cleaning up this pointer
+	m_baserec = m_records.back().record;
 
     if ( !m_baserec->isbaserecord() ) return false;
 
@@ -418,16 +626,32 @@ bool CMFTRecord::open(CNTFS *ntfs, CMFT *mft, MFT_RECNUM recnum)
 	CBlockStream *alastream = openattribute(atATTRIBUTELIST, NULL, -1);
 	if ( alastream )
 	{
+		alastream->SetIOTag(iotagMFT);
+		alastream->SetAccessHint(iohintMETADATA);
+
+		// Pull the whole list in with one read and parse it from memory
+		INT64 alalength = alastream->Length();
+		char *ala = alalength > 0 && alalength <= MFT_MAXALALENGTH ? (char *)malloc((size_t)alalength) : NULL;
+		bool alaread = ala && alastream->Read(ala, (int)alalength, 0) == alalength;
+		delete alastream;
+		if ( !alaread )
+		{
+			free(ala);
+			return false;
+		}
+
 		m_attributes.clear();
-		while ( !alastream->Eof() )
+		for(int pos = 0; pos < alalength; )
 		{
 			AttribInfo ai;
-			if ( !ai.read(alastream) ) break;
+			if ( !ai.read(ala, (int)alalength, pos) ) break;
 			m_attributes.push_back(ai);
 		}
-		delete alastream;
+		free(ala);
 		if ( m_attributes.size() == 0 ) return false;
 
+		prefetchsubrecords();
+
         // Now fixup the attribute pointers by loading the subrecords
         for(unsigned int i = 0; i < m_attributes.size(); i++)
         {
@@ -499,13 +723,21 @@ CBlockStream *CMFTRecord::openattribute(int index, bool slack)
             int length;
             if ( !m_mft->getrecinfo( ai.fragments[i].location, startcluster, length) ) return NULL;
 
-			CRamBlockStream *ramstream = new CRamBlockStream;
-			if ( !ramstream ) return NULL;
+			// point the stream straight at our copy of the record instead of copying the data out of it
+			CSharedBuffer *recbuffer = findrecordbuffer(fa);
+			if ( !recbuffer ) return NULL;
+
+			CViewBlockStream *viewstream = new CViewBlockStream;
+			if ( !viewstream ) return NULL;
 
-            ramstream->SetDev( m_ntfs );
-            ramstream->AddRun( startcluster, length );
-			ramstream->setbuffer( fa->residentstream(), fa->r.streamlength );
-			return ramstream;
+            viewstream->SetDev( m_ntfs );
+            viewstream->AddRun( startcluster, length );
+			if ( !viewstream->setview( recbuffer, fa->residentstream() - recbuffer->data(), fa->r.streamlength ) )
+			{
+				delete viewstream;
+				return NULL;
+			}
+			return viewstream;
 		}
 		if ( i == 0 )
 		{
@@ -585,6 +817,15 @@ void CMFTRecord::mergedeletedrun(fssize_t blocknum, fssize_t streamrunlen, CBloc
 	} while ( streamrunlen > 0 );
 }
 
+CSharedBuffer *CMFTRecord::findrecordbuffer(const void *ptr) const
+{
+	for(unsigned int i=0; i < m_records.size(); i++)
+	{
+		if ( m_records[i].buffer && m_records[i].buffer->contains(ptr) ) return m_records[i].buffer;
+	}
+	return NULL;
+}
+
 const void *CMFTRecord::getresidentattribute(int index, bool mkcopy) const
 {
 	if ( !isvalid() || !isvalidattributenum(index) ) return NULL;
@@ -635,21 +876,98 @@ SMFTRecord *CMFTRecord::getsubrecordbyindex(int i)
 }
 #endif
 
-SMFTRecord *CMFTRecord::getsubrecord(MFT_RECNUM recnum)
+static bool lessrecnum(const MFT_RECNUM &lhs, const MFT_RECNUM &rhs)
 {
-	for(unsigned int i=0; i < m_records.size(); i++)
+	return lhs.RecNum() < rhs.RecNum();
+}
+
+static bool samerecnum(const MFT_RECNUM &lhs, const MFT_RECNUM &rhs)
+{
+	return lhs.RecNum() == rhs.RecNum();
+}
+
+int CMFTRecord::findsubrecord(INT64 recnum) const
+{
+	int lo = 0;
+	int hi = m_records.size();
+	while ( lo < hi )
+	{
+		int mid = (lo + hi) / 2;
+		if ( m_records[mid].recnum.RecNum() < recnum )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+bool CMFTRecord::acceptsubrecord(const SMFTRecord *rec) const
+{
+	return rec->baserecnum.RecNum() == m_baserecnum.RecNum() && m_baserec->isinuse() == rec->isinuse();
+}
+
+void CMFTRecord::prefetchsubrecords()
+{
+	vector<MFT_RECNUM> wanted;
+	for(unsigned int i = 0; i < m_attributes.size(); i++)
+	{
+		const AttribInfo &ai = m_attributes[i];
+		for(unsigned int j = 0; j < ai.fragments.size(); j++)
+		{
+			if ( ai.fragments[j].location.RecNum() != m_baserecnum.RecNum() ) wanted.push_back( ai.fragments[j].location );
+		}
+	}
+	std::sort(wanted.begin(), wanted.end(), lessrecnum);
+	wanted.erase( std::unique(wanted.begin(), wanted.end(), samerecnum), wanted.end() );
+
+	// Read runs of nearby subrecords together.  Anything that doesn't load here is left for getsubrecord()
+	// to retry and reject on its own.
+	unsigned int i = 0;
+	while ( i < wanted.size() )
 	{
-		if ( m_records[i].recnum.RecNum() == recnum.RecNum() ) return m_records[i].record;
+		INT64 first = wanted[i].RecNum();
+		unsigned int j = i + 1;
+		while ( j < wanted.size() && wanted[j].RecNum() - wanted[j - 1].RecNum() <= MFT_PREFETCHMAXGAP &&
+				wanted[j].RecNum() - first < MFT_PREFETCHMAXBATCH ) j++;
+
+		int count = (int)(wanted[j - 1].RecNum() - first + 1);
+		char *batch = (char *)malloc( count * (m_recsize + sizeof(bool)) );
+		bool *valid = (bool *)(batch + count * m_recsize);
+		int got = batch ? m_mft->readrecordbatch(first, count, batch, valid) : 0;
+
+		for(unsigned int k = i; k < j; k++)
+		{
+			int index = (int)(wanted[k].RecNum() - first);
+			if ( index >= got || !valid[index] ) continue;
+
+			const SMFTRecord *rec = (const SMFTRecord *)(batch + index * m_recsize);
+			if ( !wanted[k].isseqwildcard() && rec->sequencenumber != wanted[k].SeqNum() ) continue;
+			if ( !acceptsubrecord(rec) ) continue;
+
+			CSharedBuffer *buffer = CSharedBuffer::Create(m_recsize);
+			if ( !buffer ) continue;
+			memcpy(buffer->data(), rec, m_recsize);
+			m_records.insert( m_records.begin() + findsubrecord(wanted[k].RecNum()), SubRecordInfo(wanted[k], buffer) );
+		}
+		free(batch);
+		i = j;
 	}
+}
+
+SMFTRecord *CMFTRecord::getsubrecord(MFT_RECNUM recnum)
+{
+	int i = findsubrecord(recnum.RecNum());
+	if ( i < (int)m_records.size() && m_records[i].recnum.RecNum() == recnum.RecNum() ) return m_records[i].record;
 
-	SMFTRecord *newrec = m_mft->readrawrecord(recnum);
-	if ( !newrec ) return NULL;
-	if ( newrec->baserecnum.RecNum() != m_baserecnum.RecNum() || m_baserec->isinuse() != newrec->isinuse() )
+	CSharedBuffer *newbuffer = m_mft->readsharedrecord(recnum);
+	if ( !newbuffer ) return NULL;
+	SMFTRecord *newrec = (SMFTRecord *)newbuffer->data();
+	if ( !acceptsubrecord(newrec) )
 	{
-		free(newrec);
+		newbuffer->Release();
 		return NULL;
 	}
-	m_records.push_back( SubRecordInfo(recnum, newrec) );
+	m_records.insert( m_records.begin() + i, SubRecordInfo(recnum, newbuffer) );
 	return newrec;
 }
 
@@ -36,6 +36,7 @@
 #include "NTFSBitmap.h"
 #include "ADStream.h"
 #include "BlockStream.h"
+#include "SharedBuffer.h"
 #include <vector>
 
 namespace AccessData
@@ -51,6 +52,45 @@ class CMFTRecord;
 struct SMFTRecord;
 struct SMFTAttribute;
 
+// CMFTScanSink
+// Receives the records CMFT::scan() reads, in record number order.
+class CMFTScanSink
+{
+public:
+	virtual ~CMFTScanSink() {}
+
+	// record()
+	// rec is the fixed up record, recsize bytes long, and is only good until record() returns.
+	// It's NULL for a record that couldn't be read (only with MFTSCAN_UNREAD).
+	// Return false to stop the scan.
+	virtual bool	record(INT64 recnum, SMFTRecord *rec, int recsize) = 0;
+};
+
+// CMFTAttributeIterator
+// Walks the attributes of a raw record up to the end marker, stopping early at anything
+// that would run off the end of the record.
+//		for(CMFTAttributeIterator it(rec, recsize); it.get(); it.next()) ...
+class CMFTAttributeIterator
+{
+public:
+	CMFTAttributeIterator(SMFTRecord *rec, int recsize);
+
+	SMFTAttribute*	get() const			{ return m_fa; }
+	int				index() const		{ return m_index; }		// the attribute's position in the record
+	const char*		recend() const		{ return m_recend; }
+	// true once the walk has reached the end marker, false if it stopped at a bad attribute
+	bool			complete() const	{ return m_complete; }
+	void			next();
+protected:
+	void			check();			// drops m_fa unless it's a whole attribute
+
+	SMFTRecord*		m_rec;
+	const char*		m_recend;
+	SMFTAttribute*	m_fa;
+	int				m_index;
+	bool			m_complete;
+};
+
 class CMFT
 {
 public:
@@ -64,9 +104,24 @@ public:
 	bool		bootstrap(CNTFS *ntfs, SBootRecord *bootrec);
 
     CMFTRecord*	readrecord(MFT_RECNUM recnum);
-    SMFTRecord*	readrawrecord(MFT_RECNUM recnum);
-
-	int			recordcount() const		{ return m_reccount; }
+    SMFTRecord*	readrawrecord(MFT_RECNUM recnum);		// caller must free() the result
+    CSharedBuffer*	readsharedrecord(MFT_RECNUM recnum);	// caller must Release() the result
+
+	// readrecordbatch()
+	// Reads count consecutive records starting at firstrec into dest (count * recordsize() bytes) with a single
+	// read, and fixes them up.  valid[i] is set to whether record firstrec+i is a good record.
+	// Returns the number of records read, less than count at the end of the mft.
+	int			readrecordbatch(INT64 firstrec, int count, void *dest, bool *valid);
+
+	// scan()
+	// Reads the whole mft in batches and hands every good record to sink.  With MFTSCAN_INUSE only the
+	// records that are in use (by the mft bitmap, when it can be read, and by the record's own flag) are
+	// passed, and batches with none aren't read.  With MFTSCAN_UNREAD the records that couldn't be read
+	// are passed as well, as NULL.  Returns false if the sink stopped the scan or memory ran out.
+	enum { MFTSCAN_INUSE = 1, MFTSCAN_UNREAD = 2 };
+	bool		scan(CMFTScanSink &sink, int flags = 0);
+
+	INT64		recordcount() const		{ return m_reccount; }
 	int			recordsize() const		{ return m_recsize; }
     int			recordoverhead() const	{ return m_recoverhead; }
 
@@ -82,14 +137,19 @@ protected:
 	void		initfields();
 	void		clearfields();
 	void		assignfields(const CMFT &rhs);
+	bool		loadrecord(SMFTRecord *rec, MFT_RECNUM recnum);		// read and fixup recnum into rec
+	bool		loadreserved(SBootRecord *bootrec);					// read the system records into m_reserved, from the mirror if need be
+	bool		isreserved(INT64 recnum) const	{ return recnum >= 0 && recnum < 16 && (m_reservedvalid & (1 << recnum)) != 0; }
 
 	CNTFS*			m_ntfs;
 	CBlockStream*	m_stream;
 
 	int			m_physicalblocksize;	// the physical block size of the drive, needed to correctly do fixups
 	int			m_recsize;				// the record size (in bytes) of a mft file record
-	int			m_reccount;				// the number of records in the mft stream
+	INT64		m_reccount;				// the number of records in the mft stream
     int			m_recoverhead;
+	vector<char>	m_reserved;			// the first 16 records, fixed up, as bootstrap() settled on them
+	UINT16			m_reservedvalid;	// bit n is set if record n in m_reserved is good
 private:
 	CMFT(const CMFT &rhs);		// disallow
 	CMFT &operator=(const CMFT &rhs);	// disallow
@@ -123,6 +183,8 @@ public:
 	CBlockStream*			openattribute(int index, bool slack=false);
 
 	// Returns a pointer to a resident attribute.  Use mkcopy to get a copy of the buffer you must free.
+	// Without mkcopy, the pointer is only good until this instance is cleared or reopened.  Use openattribute()
+	// if the data needs to outlive the CMFTRecord; resident streams share the record buffer instead of copying it.
 	const void*				getresidentattribute(int index, bool mkcopy=false) const;
 	const void*				getresidentattribute(int attributetype, const wchar_t *name, int identifier, bool mkcopy=false) const;
 
@@ -153,8 +215,9 @@ public:
 protected:
 	struct SubRecordInfo
 	{
-		SubRecordInfo(MFT_RECNUM rn, SMFTRecord *rp) : recnum(rn), record(rp) { }
+		SubRecordInfo(MFT_RECNUM rn, CSharedBuffer *b) : recnum(rn), buffer(b), record(b ? (SMFTRecord *)b->data() : NULL) { }
 		MFT_RECNUM		recnum;
+		CSharedBuffer*	buffer;			// the fixed up record, shared with any resident streams opened from it
 		SMFTRecord*		record;
 	};
     struct AttribFragInfo
@@ -169,7 +232,7 @@ protected:
     	void		clear();
         bool		isvalidfragmentnum(int i) const		{ return i >= 0 && i < fragments.size(); }
 		bool		read(SMFTAttribute *fa, MFT_RECNUM recnum);
-		bool		read(CStream *fin);
+		bool		read(const char *ala, int alalength, int &pos);	// reads the run of ALA entries at pos, advances pos past them
 
 		int			attributetype;
 		wstring		name;
@@ -184,8 +247,12 @@ protected:
 	void			initfields();
 	void			clearfields();
 	void			mergedeletedrun(fssize_t blocknum, fssize_t streamrunlen, CBlockStream *stream);
+	CSharedBuffer*	findrecordbuffer(const void *ptr) const;	// returns the record buffer that holds ptr
+	int				findsubrecord(INT64 recnum) const;			// index in m_records of the first entry >= recnum
+	bool			acceptsubrecord(const SMFTRecord *rec) const;
+	void			prefetchsubrecords();						// loads every subrecord the ALA references, in sorted batches
 
-	RecordVector	m_records;
+	RecordVector	m_records;			// sorted by recnum
 	AttribVector	m_attributes;
 
 	CNTFS*			m_ntfs;
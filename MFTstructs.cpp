@@ -168,6 +168,17 @@ ALArec *ALArec::read(CStream *f, void *buffer, int buffersize)
 	return rec;
 }
 
+const ALArec *ALArec::get(const void *buffer, int bufferlength)
+{
+	if ( !buffer || bufferlength < (int)sizeof(ALArec) ) return NULL;
+
+	const ALArec *rec = (const ALArec *)buffer;
+	if ( !rec->isvalid() || rec->recordlength > bufferlength ) return NULL;
+	if ( rec->nameoffset + rec->namelength * 2 > rec->recordlength ) return NULL;
+
+	return rec;
+}
+
 bool ALArec::isvalid() const
 {
 	return (recordlength >= sizeof(ALArec)) && (recordlength < MAXRECORDLENGTH);
@@ -160,6 +160,7 @@ struct ALArec
 	//wchar_t	name[1];				// 1A		start of attr name, in unicode
 
 	static ALArec *read(CStream *f, void *buffer=NULL, int buffersize=0);
+	static const ALArec *get(const void *buffer, int bufferlength);	// returns the record at buffer if it fits in bufferlength and is valid
 	bool		isvalid() const;
 	bool		compare(const ALArec &rhs) const;
 	wstring		getname() const;
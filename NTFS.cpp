@@ -35,11 +35,12 @@
 #include "RamStream.h"
 #include "NTFSFile.h"
 #include "NTFSDirectory.h"
+#include "NTFSClusterMap.h"
+#include "NTFSParentGraph.h"
 #include "ADIOFileGeneric.h"
 #include "Logger.h"
 #include "SelfDestruct.h"
 
-#include <malloc.h>
 namespace AccessData
 {
 namespace NTFS
@@ -51,13 +52,18 @@ static void foo()
 	new CNTFS;
 }
 
+#define NTFS_DEFAULTCACHESIZE	(16*1024*1024)
+
 void CNTFS::initfields()
 {
+	m_cachesize = NTFS_DEFAULTCACHESIZE;
 	m_mft.clear();
 	m_bitmap.clear();
 	m_rootdirufid = -1;
 	m_volumeserialnumber = 0;
 	m_allocatedclusters = 0;
+	m_clustermap = NULL;
+	m_parentgraph = NULL;
 }
 
 void CNTFS::clearfields()
@@ -67,6 +73,16 @@ void CNTFS::clearfields()
 	m_rootdirufid = -1;
 	m_volumeserialnumber = 0;
 	m_allocatedclusters = 0;
+	m_indexdir.clear();
+	delete m_clustermap;
+	m_clustermap = NULL;
+	delete m_parentgraph;
+	m_parentgraph = NULL;
+	m_cache.clear();
+	m_extentcache.clear();
+#ifdef ADIO_IOSTATS
+	m_iostats.clear();
+#endif
 }
 
 /*void CNTFS::assignfields(const CNTFS &rhs)
@@ -98,6 +114,47 @@ void CNTFS::clear()
 	clearfields();
 }
 
+void CNTFS::setreadahead(CBlockStream *s)
+{
+	if ( s && !istracing() ) s->SetReadAhead();
+}
+
+CNTFSClusterMap *CNTFS::getclustermap()
+{
+	if ( m_clustermap || !isvalid() ) return m_clustermap;
+
+	CNTFSClusterMap *clustermap = new CNTFSClusterMap;
+	if ( !clustermap ) return NULL;
+
+	CPath filename;
+	if ( !m_indexdir.isblank() )
+	{
+		filename = m_indexdir;
+		filename += string("clusters.map");
+	}
+
+	if ( filename.isblank() || !clustermap->load(filename, this) )
+	{
+		if ( !clustermap->build(this) ) { delete clustermap; return NULL; }
+		if ( !filename.isblank() ) clustermap->save(filename, this);
+	}
+
+	m_clustermap = clustermap;
+	return m_clustermap;
+}
+
+CNTFSParentGraph *CNTFS::getparentgraph()
+{
+	if ( m_parentgraph || !isvalid() ) return m_parentgraph;
+
+	CNTFSParentGraph *parentgraph = new CNTFSParentGraph;
+	if ( !parentgraph ) return NULL;
+	if ( !parentgraph->build(this) ) { delete parentgraph; return NULL; }
+
+	m_parentgraph = parentgraph;
+	return m_parentgraph;
+}
+
 UFID_t CNTFS::getufidbypath(const CPath &path)
 {
 	if ( !path.is(PATH_WIN) || path.is(PATH_UNC) ) return -1;
@@ -131,7 +188,7 @@ CNTFSFile *CNTFS::openfile(MFT_RECNUM recnum, UINT16 attribnum, bool slack)
 {
 	if ( !isvalid() || !m_mft.isvalidrecnum(recnum) ) return NULL;
 
-	if ( recnum.RecNum() == UNALLOCRECNUM || recnum.RecNum() == FSSLACKRECNUM ) return NULL;
+	if ( recnum.RecNum() == UFID_RECNUM(UNALLOCRECNUM) || recnum.RecNum() == UFID_RECNUM(FSSLACKRECNUM) ) return NULL;
 
 	CNTFSFile *newfile = new CNTFSFile;
 	if ( !newfile ) return NULL;
@@ -173,20 +230,25 @@ CFile *CNTFS::OpenFile(UFID_t ufid)
 
 	UINT16 attribnum;
 	UINT64 recnum;
+	UINT16 seqnum;
 	bool isslack;
-	ufid2ntfs(ufid, attribnum, recnum, isslack);
+	if ( !ufid2ntfs(ufid, attribnum, recnum, seqnum, isslack) ) return NULL;
 	TRACEARG( recnum, "%I64d");
+	TRACEARG( seqnum, "%d");
 	TRACEARG( attribnum, "%d");
 	TRACEARG( isslack, "%d");
 
 	switch ( recnum )
 	{
-		case (UINT32)UNALLOCRECNUM:
+		case UFID_RECNUM(UNALLOCRECNUM):
 		{
 			CBlockStream *newstream = new CBlockStream;
 			if ( !newstream ) return NULL;
 
 			newstream->SetDev(this);
+			newstream->SetIOTag(iotagFILEDATA);
+			newstream->SetAccessHint(iohintBULK);
+			setreadahead(newstream);
 
 			bool b;
 			fssize_t start=0, len;
@@ -207,12 +269,12 @@ CFile *CNTFS::OpenFile(UFID_t ufid)
 			return newfile;
 		}
 		break;
-		case (UINT32)FSSLACKRECNUM:
+		case UFID_RECNUM(FSSLACKRECNUM):
 		{
 			return NULL;
 		}
 		break;
-        case (UINT32)ORPHANRECNUM:
+        case UFID_RECNUM(ORPHANRECNUM):
         {
         	CRamBlockStream *stream = new CRamBlockStream;
             stream->SetDev(this);
@@ -223,7 +285,8 @@ CFile *CNTFS::OpenFile(UFID_t ufid)
         break;
 		default:
 		{
-			return openfile( MFT_RECNUM(recnum), attribnum, isslack);
+			// a record that was reused since the UFID was made fails to load
+			return openfile( MFT_RECNUM(seqnum, recnum), attribnum, isslack);
 		}
 		break;
 	}
@@ -237,12 +300,13 @@ CDirectory *CNTFS::GetDirectory(UFID_t ufid)
 
 	UINT16 attribnum;
     UINT64 recnum;
+    UINT16 seqnum;
     bool isslack;
-    ufid2ntfs(ufid, attribnum, recnum, isslack);
+    if ( !ufid2ntfs(ufid, attribnum, recnum, seqnum, isslack) ) return NULL;
 
 	CNTFSDirectory *dir = new CNTFSDirectory;
 	if ( !dir ) return NULL;
-	if ( !dir->open(this, MFT_RECNUM( recnum ) ) ) { delete dir; return NULL; }
+	if ( !dir->open(this, MFT_RECNUM( seqnum, recnum ) ) ) { delete dir; return NULL; }
 	return dir;
 }
 
@@ -251,7 +315,7 @@ CDirectory *CNTFS::GetRootDirectory()
 	//CSingleLock lock(&m_Mutex);
 	//lock.Lock();
 
-	return GetDirectory( ntfs2ufid(0, sfrRootDir, false) );
+	return GetDirectory( ntfs2ufid(0, sfrRootDir, 0, false) );
 }
 
 UFID_t CNTFS::GetRootDirectoryUFID() const
@@ -267,7 +331,7 @@ UFID_t CNTFS::GetUnallocUFID() const
 	//CSingleLock lock((CMutex*)&m_Mutex);
 	//lock.Lock();
 
-	return ntfs2ufid(0, UNALLOCRECNUM, false);
+	return ntfs2ufid(0, UNALLOCRECNUM, 0, false);
 }
 
 UFID_t CNTFS::GetSlackUFID() const
@@ -275,72 +339,101 @@ UFID_t CNTFS::GetSlackUFID() const
 	//CSingleLock lock((CMutex*)&m_Mutex);
 	//lock.Lock();
 
-	return ntfs2ufid(0, FSSLACKRECNUM, false);
+	return ntfs2ufid(0, FSSLACKRECNUM, 0, false);
 }
 
+// CQueryUFIDVector
+// Collects QueryUFIDs() results for the vector version
+class CQueryUFIDVector : public CQueryUFIDSink
+{
+public:
+	CQueryUFIDVector(vector<UFID_t> &ufids) : m_ufids(ufids) { }
+	bool ufids(const SQueryUFID *results, int count)
+	{
+		for(int i = 0; i < count; i++) m_ufids.push_back(results[i].ufid);
+		return true;
+	}
+protected:
+	vector<UFID_t>&	m_ufids;
+};
+
 bool CNTFS::QueryUFIDs(vector<UFID_t> &ufids, int queryoptions)
 {
+	CQueryUFIDVector sink(ufids);
+	return QueryUFIDs(sink, queryoptions);
+}
+
+// CQueryUFIDScan
+// Turns the base records of a CMFT::scan() into UFIDs for CNTFS::QueryUFIDs().
+// Records whose batch couldn't be read are opened anyway, in case they read on their own.
+class CQueryUFIDScan : public CMFTScanSink
+{
+public:
+	CQueryUFIDScan(CNTFS *ntfs, CQueryUFIDBatch &batch, int queryoptions) : m_ntfs(ntfs), m_batch(batch), m_queryoptions(queryoptions) {}
+
+	bool	record(INT64 recnum, SMFTRecord *rec, int recsize);
+private:
+	CNTFS*				m_ntfs;
+	CQueryUFIDBatch&	m_batch;
+	int					m_queryoptions;
+};
+
+bool CQueryUFIDScan::record(INT64 recnum, SMFTRecord *rec, int recsize)
+{
+	if ( recnum == sfrBadClusters ) return true;
+	if ( rec && !rec->isbaserecord() ) return true;
+	UINT32 deleted = (rec && !rec->isinuse()) ? CFileSystem::QUFIDDELETED : 0;
+	bool getslack = (m_queryoptions & CFileSystem::INCLUDESLACK) == CFileSystem::INCLUDESLACK;
+
+	CNTFSFile ntfsfile;
+	if ( !ntfsfile.open(m_ntfs, &m_ntfs->getmft(), recnum, 0, false) ) return true;
+
+	UINT16 ir, ar, bm;
+	bool hasdir = ntfsfile.getdirattribnums(ir, ar, bm);
+	UINT16 seqnum = ntfsfile.seqnum();
+
+	bool stopped = false;
+	if ( (m_queryoptions & CFileSystem::INCLUDEFILES) == CFileSystem::INCLUDEFILES )
+	{
+		vector<UINT16> attribnums;
+		ntfsfile.getdataattribnums( attribnums );
+		for(unsigned int j = 0; j < attribnums.size() && !stopped; j++)
+		{
+			UINT16 attribnum = attribnums[j];
+			stopped = !m_batch.add( ntfs2ufid(attribnum, recnum, seqnum, false), CFileSystem::QUFIDFILE | deleted );
+			if ( !stopped && getslack && ntfsfile.setdefaultattrib(attribnum, true) ) stopped = !m_batch.add( ntfs2ufid(attribnum, recnum, seqnum, true), CFileSystem::QUFIDSLACK | deleted );
+		}
+		if ( !stopped && hasdir && ar != 0xFFFF )
+			stopped = !m_batch.add( ntfs2ufid(ar, recnum, seqnum, false), CFileSystem::QUFIDFILE | deleted );
+	}
+	if ( !stopped && hasdir && (m_queryoptions & CFileSystem::INCLUDEDIRS) == CFileSystem::INCLUDEDIRS )
+	{
+		stopped = !m_batch.add( ntfs2ufid(ir, recnum, seqnum, false), CFileSystem::QUFIDDIRECTORY | deleted );
+	}
+	return !stopped;
+}
+
+bool CNTFS::QueryUFIDs(CQueryUFIDSink &sink, int queryoptions)
+{
+	if ( !isvalid() ) return false;
+
+	CQueryUFIDBatch batch(sink);
     if ( (queryoptions & (INCLUDEFILES|INCLUDEDIRS) ) != 0 )
     {
-    	bool getslack = (queryoptions & INCLUDESLACK) == INCLUDESLACK;
-        for( int recnum = 0, reccount = m_mft.recordcount(); recnum < reccount; recnum++ )
-        {
-            if ( recnum == sfrBadClusters ) continue;
-
-            CNTFSFile ntfsfile;
-            if ( !ntfsfile.open(this, &m_mft, recnum, 0, false) ) continue;
-
-			UINT16 ir, ar, bm;
-			bool hasdir = ntfsfile.getdirattribnums(ir, ar, bm);
-
-            if ( (queryoptions & INCLUDEFILES) == INCLUDEFILES )
-            {
-	            vector<UINT16> attribnums;
-    	        ntfsfile.getdataattribnums( attribnums );
-                for(int i = 0; i < attribnums.size(); i++)
-                {
-                	UINT16 attribnum = attribnums[i];
-                    ufids.push_back( ntfs2ufid(attribnum, recnum, false) );
-                    if ( getslack && ntfsfile.setdefaultattrib(attribnum, true) ) ufids.push_back( ntfs2ufid(attribnum, recnum, true) );
-                }
-                if ( hasdir && ar != 0xFFFF )
-                	ufids.push_back( ntfs2ufid(ar, recnum, false) );
-            }
-            if ( hasdir && (queryoptions & INCLUDEDIRS) == INCLUDEDIRS )
-            {
-				ufids.push_back( ntfs2ufid(ir, recnum, false) );
-            }
-        }
+    	// a quick look at the records first, so the ones that can't be files aren't opened
+    	CQueryUFIDScan scan(this, batch, queryoptions);
+    	if ( !m_mft.scan(scan, CMFT::MFTSCAN_UNREAD) ) return false;
     }
     if ( (queryoptions & INCLUDESPECIAL) == INCLUDESPECIAL )
     {
-		ufids.push_back( ntfs2ufid(0, UNALLOCRECNUM, false) );
-        if ( translateclusternum(m_clustercount) < m_blockcount ) ufids.push_back( ntfs2ufid(0, FSSLACKRECNUM, false) );
+		if ( !batch.add( ntfs2ufid(0, UNALLOCRECNUM, 0, false), QUFIDSPECIAL ) ) return false;
+        if ( translateclusternum(m_clustercount) < m_blockcount && !batch.add( ntfs2ufid(0, FSSLACKRECNUM, 0, false), QUFIDSPECIAL ) ) return false;
     }
     if ( (queryoptions & INCLUDEDIRS) == INCLUDEDIRS )
     {
-		ufids.push_back( ntfs2ufid(0, ORPHANRECNUM, false) );
+		if ( !batch.add( ntfs2ufid(0, ORPHANRECNUM, 0, false), QUFIDDIRECTORY | QUFIDSPECIAL ) ) return false;
     }
-//#if 0
-    FILE *fout = fopen("c:\\query.txt", "at");
-    if ( fout )
-    {
-    	LARGE_INTEGER li;
-    	for(int i = 0; i < ufids.size(); i++)
-        {
-        	UINT16 attrib;
-            UINT64 recnum;
-            bool slack;
-            ufid2ntfs(ufids[i], attrib, recnum, slack);
-			li.QuadPart = ufids[i];
-        	fprintf(fout, "%X%X", li.HighPart, li.LowPart);
-            li.QuadPart = recnum;
-            fprintf(fout, ": recnum=%X%X, attrib=%d, slack=%d\n", li.HighPart, li.LowPart, attrib, slack);
-        }
-    	fclose(fout);
-    }
-//#endif
-    return true;
+    return batch.flush();
 }
 
 bool CNTFS::IsBlockAllocated(fssize_t blocknum)
@@ -395,6 +488,11 @@ bool CNTFS::Mount(CFTKBlockDevice *dev, const CPath &indexdir, CJobCallBack &cal
 
 	clear();
 
+#ifdef ADIO_IOSTATS
+	// count everything from here on, including the boot record
+	if ( dev && m_iostats.attach(dev) ) dev = &m_iostats;
+#endif
+
 	SBootRecord bootrec;
 	if ( !dev || !bootrec.Read(dev) || !bootrec.isvalidntfs() ) { TRACELOG0("not valid bootrec"); return false; }
 
@@ -405,11 +503,19 @@ bool CNTFS::Mount(CFTKBlockDevice *dev, const CPath &indexdir, CJobCallBack &cal
 	if ( bpbscale == 0 ) return false;
 	if ( bpbbs != devbs ) return false;
 
+	// cache whole clusters, and keep the MFT and directory indexes around
+	if ( m_cachesize > 0 && m_cache.attach(dev, bpbscale, m_cachesize) )
+	{
+		m_cache.setpinning( (1u << iotagMFT) | (1u << iotagINDEX), m_cachesize / 4 );
+		dev = &m_cache;
+	}
+
 	// This sets the block to cluster translation info.
 	int bpbbc = bootrec.bpb.ntfs.blockcount;
 	if ( !setblockdevice(dev) || !setclustertranslation(bpbscale, 0, bpbbc / bpbscale, 0) ) { TRACELOG0("failed to set bd and cluster xlat"); return false; }
 
 	m_volumeserialnumber = bootrec.bpb.ntfs.volumeserialnumber;
+	m_indexdir = indexdir;
 
 
 	// Read the mft
@@ -419,8 +525,9 @@ bool CNTFS::Mount(CFTKBlockDevice *dev, const CPath &indexdir, CJobCallBack &cal
 	CMFTRecord mftrec;
 	if ( !mftrec.open(this, &m_mft, MFT_RECNUM(sfrBitmap)) ) { TRACELOG0("could not open $bitmap"); return false; }
 
-	CStream *s = mftrec.openattribute(atDATA, NULL, -1);
+	CBlockStream *s = mftrec.openattribute(atDATA, NULL, -1);
 	if ( !s ) { TRACELOG0("could not get $bitmap stream"); return false; }
+	s->SetIOTag(iotagBITMAP);
 
 	if ( !m_bitmap.open(s) ) { delete s; TRACELOG0("could not init m_bitmap with stream"); return false; }
 
@@ -438,7 +545,7 @@ bool CNTFS::Mount(CFTKBlockDevice *dev, const CPath &indexdir, CJobCallBack &cal
 	if ( !mftrec.open(this, &m_mft, MFT_RECNUM(sfrRootDir)) ) { TRACELOG0("failed to open rootdir mft record"); return false; }
 	int attribnum = mftrec.findattribute(atINDEXROOT, NULL, -1);
 	if ( attribnum < 0 ) { TRACELOG0("failed to get attribnum for rootdir"); return false; }
-	m_rootdirufid = ntfs2ufid(sfrRootDir, attribnum, false);
+	m_rootdirufid = ntfs2ufid(attribnum, sfrRootDir, mftrec.seqnum(), false);
 
 	selfdestruct.disarm();
 	return true;
@@ -37,6 +37,9 @@
 #include "MFT.h"
 #include "NTFSBitmap.h"
 #include "NTFSCommon.h"
+#include "IOStats.h"
+#include "BlockCache.h"
+#include "NTFSExtentCache.h"
 
 namespace AccessData
 {
@@ -46,6 +49,8 @@ namespace NTFS
 // fwd defines
 class CNTFSFile;
 class CFTKNTFSDirectory;
+class CNTFSClusterMap;
+class CNTFSParentGraph;
 
 class CNTFS : public CFSBase
 {
@@ -59,6 +64,40 @@ public:
 	UFID_t				getufidbypath(const CPath &path);
     CMFT&				getmft() { return m_mft; }
     CFTKBlockDevice*	getdev() { return m_dev; }
+	UINT32				getvolumeserialnumber() const { return m_volumeserialnumber; }
+
+	// getclustermap()
+	// Returns the map of which file owns which cluster, building it the first time it's asked for.
+	// If Mount() was given an index directory, the map is loaded from there when it was saved
+	// for this volume before, and saved there after it's built.
+	CNTFSClusterMap*	getclustermap();
+
+	// getparentgraph()
+	// Returns every record's parent directory, building it the first time it's asked for.
+	// Once it's built, files opened from this volume take their parent from it.
+	CNTFSParentGraph*	getparentgraph();
+
+	// setcachesize()
+	// Sets the size of the cluster cache used by the next Mount(), 0 turns it off.
+	// MFT and index clusters are pinned in up to a quarter of it.
+	void				setcachesize(INT64 bytes)	{ m_cachesize = bytes; }
+	void				getcachestats(SBlockCacheStats &stats)	{ m_cache.getstats(stats); }
+
+	// setextentcachesize()
+	// Caps the memory used to remember the run lists of files that have been opened, 0 turns it off.
+	void				setextentcachesize(INT64 bytes)	{ m_extentcache.setmaxbytes(bytes); }
+	void				getextentcachestats(SExtentCacheStats &stats)	{ m_extentcache.getstats(stats); }
+
+	// setreadahead()
+	// Turns on readahead for a stream on this volume, unless settrace() is recording;
+	// the trace should show the reads the code asked for, not the grown ones.
+	void				setreadahead(CBlockStream *s);
+
+#ifdef ADIO_IOSTATS
+	// Counters for all the reads this volume has made since it was mounted
+	void				getiostats(SIOStats &stats)	{ m_iostats.getstats(stats); }
+	void				resetiostats()					{ m_iostats.resetstats(); }
+#endif
 
 	//
 	// CFTKFileSystem inherited functions
@@ -70,6 +109,7 @@ public:
 	UFID_t				GetUnallocUFID() const;
 	UFID_t				GetSlackUFID() const;
     bool				QueryUFIDs(vector<UFID_t> &ufids, int queryoptions);
+    bool				QueryUFIDs(CQueryUFIDSink &sink, int queryoptions);
 	bool				IsBlockAllocated(fssize_t blocknum);
 	bool				IsBlockUnallocated(fssize_t blocknum);
 	fssize_t			FreeBlockCount();
@@ -90,8 +130,9 @@ protected:
 
 	CNTFSFile*		openfile(MFT_RECNUM recnum, UINT16 attribnum, bool slack);	// Open an ntfs file by record number
 	wstring			getfilename(MFT_RECNUM fileref);	// get a file's name from cache	NEEDS WORK
-    UFID_t			orphandirufid() { return ntfs2ufid(0, ORPHANRECNUM, false); }
+    UFID_t			orphandirufid() { return ntfs2ufid(0, ORPHANRECNUM, 0, false); }
 
+	// record numbers for the things that aren't in the mft.  UFID_RECNUM() of these are the top of the 31 bit range.
 	enum { UNALLOCRECNUM = -2, FSSLACKRECNUM = -3, ORPHANRECNUM = -4 };
 
 	CMFT				m_mft;
@@ -99,6 +140,15 @@ protected:
 	UFID_t				m_rootdirufid;
 	UINT32				m_volumeserialnumber;
 	fssize_t			m_allocatedclusters;
+	CPath				m_indexdir;
+	CNTFSClusterMap*	m_clustermap;		// NULL until getclustermap() is called
+	CNTFSParentGraph*	m_parentgraph;		// NULL until getparentgraph() is called
+	INT64				m_cachesize;		// survives clear(), only set by setcachesize()
+	CBlockCache			m_cache;			// between us and m_iostats (if any) or the device passed to Mount()
+	CNTFSExtentCache	m_extentcache;		// run lists of opened files, shared by every CNTFSFile on this volume
+#ifdef ADIO_IOSTATS
+	CIOStatsBlockDevice	m_iostats;			// sits between us and the device passed to Mount()
+#endif
 private:
 	void initfields();
 	void clearfields();
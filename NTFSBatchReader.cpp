@@ -0,0 +1,275 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "NTFSBatchReader.h"
+#include "NTFS.h"
+#include "ADIOFile.h"
+#include "Logger.h"
+
+#include <malloc.h>
+#include <string.h>
+#include <algorithm>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+#define BATCH_DEFAULTBUFFERSIZE		(1024*1024)
+
+bool CNTFSOrderedSink::chunk(UFID_t ufid, INT64 offset, const void *data, int length)
+{
+	SFileState &state = m_files[ufid];		// new files start with next = 0
+
+	if ( offset != state.next )
+	{
+		// hold on to it until everything before it has gone through
+		vector<char> &copy = state.early[offset];
+		copy.assign( (const char *)data, (const char *)data + length );
+		return true;
+	}
+
+	if ( !m_target.chunk(ufid, offset, data, length) ) return false;
+	state.next += length;
+
+	// pass on anything that was waiting for this chunk
+	map< INT64, vector<char> >::iterator i;
+	while ( (i = state.early.begin()) != state.early.end() && i->first == state.next )
+	{
+		int n = i->second.size();
+		if ( n > 0 && !m_target.chunk(ufid, i->first, &i->second[0], n) ) return false;
+		state.next += n;
+		state.early.erase(i);
+	}
+	return true;
+}
+
+void CNTFSOrderedSink::filedone(UFID_t ufid, bool complete)
+{
+	map<UFID_t, SFileState>::iterator f = m_files.find(ufid);
+	if ( f != m_files.end() )
+	{
+		// only left over if part of the file couldn't be read, pass on what's there in order
+		map< INT64, vector<char> > &early = f->second.early;
+		for(map< INT64, vector<char> >::iterator i = early.begin(); i != early.end(); ++i)
+		{
+			if ( !i->second.empty() ) m_target.chunk(ufid, i->first, &i->second[0], i->second.size());
+		}
+		m_files.erase(f);
+	}
+	m_target.filedone(ufid, complete);
+}
+
+//-----------------------------------------------------------------------------
+
+void CNTFSBatchReader::initfields()
+{
+	m_ntfs = NULL;
+	m_buffersize = BATCH_DEFAULTBUFFERSIZE;
+	m_buffer = NULL;
+}
+
+void CNTFSBatchReader::clearfields()
+{
+	m_ntfs = NULL;
+	m_ufids.clear();
+	m_buffersize = BATCH_DEFAULTBUFFERSIZE;
+	if ( m_buffer ) free(m_buffer);
+	m_buffer = NULL;
+}
+
+CNTFSBatchReader::CNTFSBatchReader()
+{
+	initfields();
+}
+
+CNTFSBatchReader::~CNTFSBatchReader()
+{
+	clearfields();
+}
+
+bool CNTFSBatchReader::isvalid() const
+{
+	return m_ntfs != NULL;
+}
+
+void CNTFSBatchReader::clear()
+{
+	clearfields();
+}
+
+bool CNTFSBatchReader::open(CNTFS *ntfs)
+{
+	clear();
+	if ( !ntfs || !ntfs->isvalid() ) return false;
+
+	m_ntfs = ntfs;
+	return true;
+}
+
+bool CNTFSBatchReader::gather(int file, vector<SBatchFile> &files, vector<SExtent> &extents, CNTFSBatchSink &sink)
+{
+	SBatchFile &bf = files[file];
+
+	CFile *f = m_ntfs->OpenFile(bf.ufid);
+	CBlockStream *s = f ? f->Open() : NULL;
+	delete f;
+	if ( !s )
+	{
+		TRACELOG0("could not open file");
+		bf.complete = false;
+		sink.filedone(bf.ufid, false);
+		return true;
+	}
+
+	int clustersize = m_ntfs->ftkbioBlockSize();
+	int maxclusters = m_buffersize / clustersize > 0 ? m_buffersize / clustersize : 1;
+	INT64 length = s->Length();
+	bool result = true;
+
+	if ( s->GetDev() == m_ntfs && s->RunCount() > 0 && s->GetInitialOffset() == 0 )
+	{
+		// one extent per run, split so that each fits in the buffer
+		INT64 logicalstart, physicalstart, count;
+		for(int r = 0; r < s->RunCount() && s->GetRunInfo(r, logicalstart, physicalstart, count); r++)
+		{
+			for(INT64 c = 0; c < count; c += maxclusters)
+			{
+				INT64 offset = (logicalstart + c) * clustersize;
+				if ( offset >= length ) break;
+
+				SExtent e;
+				e.cluster = physicalstart == -1 ? -1 : physicalstart + c;
+				e.offset = offset;
+				e.length = (int)ad_min( ad_min(count - c, (INT64)maxclusters) * clustersize, length - offset );
+				e.file = file;
+				extents.push_back(e);
+				bf.pending++;
+			}
+		}
+	}
+	else
+	{
+		// resident, not made of volume clusters, or starting part way into its first cluster
+		// (the slack after a file's data), just read it
+		for(INT64 offset = 0; offset < length && result; )
+		{
+			int n = s->Read(m_buffer, (int)ad_min(length - offset, (INT64)m_buffersize), offset);
+			if ( n <= 0 ) { bf.complete = false; break; }
+			result = sink.chunk(bf.ufid, offset, m_buffer, n);
+			offset += n;
+		}
+	}
+	delete s;
+
+	if ( result && bf.pending == 0 ) sink.filedone(bf.ufid, bf.complete);
+	return result;
+}
+
+bool CNTFSBatchReader::deliver(const SExtent &extent, const char *data, vector<SBatchFile> &files, CNTFSBatchSink &sink)
+{
+	SBatchFile &bf = files[extent.file];
+
+	bool result = true;
+	if ( data ) result = sink.chunk(bf.ufid, extent.offset, data, extent.length);
+	else bf.complete = false;
+
+	if ( result && --bf.pending == 0 ) sink.filedone(bf.ufid, bf.complete);
+	return result;
+}
+
+bool CNTFSBatchReader::run(CNTFSBatchSink &sink)
+{
+	if ( !isvalid() ) return false;
+
+	// the whole batch is one big sequential read, keep it out of the cluster cache
+	CIOTagScope iotag(iotagFILEDATA, iohintBULK);
+
+	int clustersize = m_ntfs->ftkbioBlockSize();
+	int maxclusters = m_buffersize / clustersize > 0 ? m_buffersize / clustersize : 1;
+	if ( m_buffer ) free(m_buffer);
+	m_buffer = (char *)malloc(maxclusters * clustersize);
+	if ( !m_buffer ) return false;
+
+	vector<UFID_t> ufids;
+	ufids.swap(m_ufids);
+	std::sort(ufids.begin(), ufids.end());
+	ufids.erase( std::unique(ufids.begin(), ufids.end()), ufids.end() );
+
+	vector<SBatchFile> files(ufids.size());
+	vector<SExtent> extents;
+	for(unsigned int i = 0; i < ufids.size(); i++)
+	{
+		files[i].ufid = ufids[i];
+		files[i].pending = 0;
+		files[i].complete = true;
+		if ( !gather(i, files, extents, sink) ) return false;
+	}
+
+	// sparse extents (cluster -1) sort first and don't need the device
+	std::sort(extents.begin(), extents.end(), clusterorder);
+
+	unsigned int i = 0;
+	for( ; i < extents.size() && extents[i].cluster == -1; i++)
+	{
+		memset(m_buffer, 0, extents[i].length);
+		if ( !deliver(extents[i], m_buffer, files, sink) ) return false;
+	}
+
+	while ( i < extents.size() )
+	{
+		// merge the extents that follow on from each other on disk into one read
+		fssize_t start = extents[i].cluster;
+		int total = div_roundup(extents[i].length, clustersize);
+		unsigned int j = i + 1;
+		while ( j < extents.size() )
+		{
+			int n = div_roundup(extents[j].length, clustersize);
+			if ( extents[j].cluster != start + total || total + n > maxclusters ) break;
+			total += n;
+			j++;
+		}
+
+		int r = m_ntfs->ftkbioBlockReadN(m_buffer, start, total);
+		for( ; i < j; i++)
+		{
+			int pos = (int)(extents[i].cluster - start);
+			bool ok = r >= pos + div_roundup(extents[i].length, clustersize);
+			if ( !deliver(extents[i], ok ? m_buffer + pos * clustersize : NULL, files, sink) ) return false;
+		}
+	}
+
+	return true;
+}
+
+}		// end namespace NTFS
+}		// end namespace AccessData
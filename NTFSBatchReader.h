@@ -0,0 +1,160 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef NTFSBATCHREADER_H
+#define NTFSBATCHREADER_H
+
+#include "ADIOTypes.h"
+#include <vector>
+#include <map>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+using std::vector;
+using std::map;
+
+// fwd defines
+class CNTFS;
+
+// CNTFSBatchSink
+// Receives the data read by a CNTFSBatchReader.
+class CNTFSBatchSink
+{
+public:
+	virtual ~CNTFSBatchSink() { }
+
+	// chunk()
+	// length bytes of ufid's data, starting at offset in the file.  Chunks of one file
+	// arrive in disk order, not file order (see CNTFSOrderedSink).  data is only good
+	// for the duration of the call.  Return false to stop the batch.
+	virtual bool	chunk(UFID_t ufid, INT64 offset, const void *data, int length) = 0;
+
+	// filedone()
+	// Called once per ufid, after its last chunk.  complete is false if the file couldn't
+	// be opened or some of it couldn't be read.
+	virtual void	filedone(UFID_t ufid, bool complete) { }
+};
+
+// CNTFSOrderedSink
+// Puts each file's chunks back into file order before passing them on.  Chunks that
+// arrive early are copied and held until the data before them shows up, so a badly
+// fragmented file can hold most of itself in memory.
+class CNTFSOrderedSink : public CNTFSBatchSink
+{
+public:
+	CNTFSOrderedSink(CNTFSBatchSink &target) : m_target(target) { }
+
+	bool			chunk(UFID_t ufid, INT64 offset, const void *data, int length);
+	void			filedone(UFID_t ufid, bool complete);
+protected:
+	struct SFileState
+	{
+		INT64							next;			// the offset that can be passed on next
+		map< INT64, vector<char> >		early;			// chunks that arrived before next got to them
+	};
+
+	CNTFSBatchSink&				m_target;
+	map<UFID_t, SFileState>		m_files;
+private:
+	CNTFSOrderedSink(const CNTFSOrderedSink &rhs);				// disallow
+	CNTFSOrderedSink &operator=(const CNTFSOrderedSink &rhs);	// disallow
+};
+
+// CNTFSBatchReader
+// Reads the data of a set of files in one pass across the volume.  All of the files'
+// runs are gathered first and sorted by cluster, then the volume is read from the
+// lowest cluster to the highest, merging runs that sit next to each other into one
+// device read.  Resident files and files that don't live on the volume's clusters are
+// read (in file order) before the pass, and sparse runs are handed out as zeros.
+class CNTFSBatchReader
+{
+public:
+	CNTFSBatchReader();
+	~CNTFSBatchReader();
+
+	bool			isvalid() const;
+	void			clear();
+
+	bool			open(CNTFS *ntfs);
+
+	// add()
+	// Queues the default stream of ufid.  Adding the same ufid twice reads it once.
+	void			add(UFID_t ufid)					{ m_ufids.push_back(ufid); }
+	void			add(const vector<UFID_t> &ufids)	{ m_ufids.insert(m_ufids.end(), ufids.begin(), ufids.end()); }
+
+	// The most that gets read from the device at once, 1M by default
+	void			setbuffersize(int bytes)			{ m_buffersize = bytes; }
+
+	// run()
+	// Reads every queued file into sink, then empties the queue.
+	// Returns false if the batch was stopped by the sink or couldn't be set up.
+	bool			run(CNTFSBatchSink &sink);
+protected:
+	struct SExtent
+	{
+		fssize_t	cluster;			// on the volume, -1 for sparse
+		INT64		offset;				// in the file, in bytes
+		int			length;				// in bytes
+		int			file;				// index into files
+	};
+	struct SBatchFile
+	{
+		UFID_t		ufid;
+		int			pending;			// extents not delivered yet
+		bool		complete;
+	};
+	static bool		clusterorder(const SExtent &a, const SExtent &b)	{ return a.cluster < b.cluster; }
+
+	// open a file and add its extents, or read it right away if it doesn't have any.  false if the sink stopped the batch.
+	bool			gather(int file, vector<SBatchFile> &files, vector<SExtent> &extents, CNTFSBatchSink &sink);
+	// hand an extent to the sink and finish its file when it's the last one
+	bool			deliver(const SExtent &extent, const char *data, vector<SBatchFile> &files, CNTFSBatchSink &sink);
+
+	CNTFS*				m_ntfs;
+	vector<UFID_t>		m_ufids;
+	int					m_buffersize;
+	char*				m_buffer;
+private:
+	void initfields();
+	void clearfields();
+
+	CNTFSBatchReader(const CNTFSBatchReader &rhs);				// disallow
+	CNTFSBatchReader &operator=(const CNTFSBatchReader &rhs);	// disallow
+};
+
+}		// end namespace NTFS
+}		// end namespace AccessData
+
+#endif
@@ -0,0 +1,331 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "NTFSClusterMap.h"
+#include "NTFS.h"
+#include "MFT.h"
+#include "MFTstructs.h"
+#include "NTFScommon.h"
+#include "Logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+static const char CLUSTERMAPMAGIC[8] = { 'N', 'T', 'F', 'S', 'C', 'M', 'P', '2' };
+
+#pragma pack(push,1)
+struct SClusterMapFileHeader
+{
+	char		magic[8];
+	UINT32		volumeserialnumber;
+	fssize_t	clustercount;
+	INT64		recordcount;
+	UINT64		fingerprint;
+	INT64		extentcount;
+};
+
+// SLogFileRestartPage
+// The start of a $LogFile restart page.  There are two, at 0 and at systempagesize.
+struct SLogFileRestartPage
+{
+	enum { RSTRSIG = 0x52545352 };				// "RSTR"
+	UINT32		sig;
+	UINT16		fixuplistoffset;
+	UINT16		fixuplistcount;
+	UINT64		chkdsklsn;
+	UINT32		systempagesize;
+	UINT32		logpagesize;
+	UINT16		restartareaoffset;				// the restart area starts with the current LSN
+};
+#pragma pack(pop)
+
+// restartlsn()
+// Returns the current LSN from the $LogFile restart page at pos, 0 if there isn't a good one.
+static UINT64 restartlsn(CStream *log, INT64 pos, UINT32 *systempagesize)
+{
+	// the LSN is well inside the first sector, so it's the same before and after fixups
+	char sector[512];
+	if ( log->Read(sector, sizeof(sector), pos) != sizeof(sector) ) return 0;
+
+	const SLogFileRestartPage *page = (const SLogFileRestartPage *)sector;
+	if ( page->sig != SLogFileRestartPage::RSTRSIG ) return 0;
+	if ( page->restartareaoffset < sizeof(SLogFileRestartPage) || page->restartareaoffset + sizeof(UINT64) > 510 ) return 0;
+
+	if ( systempagesize ) *systempagesize = page->systempagesize;
+	return *(const UINT64 *)(sector + page->restartareaoffset);
+}
+
+// volumefingerprint()
+// A value that changes whenever the volume is written to: the newest current LSN in the
+// $LogFile restart pages, mixed with an FNV-1a hash of the MFT's record bitmap.  0 if
+// either can't be read, in which case a saved map can't be checked against the volume.
+static UINT64 volumefingerprint(CNTFS *ntfs)
+{
+	CMFTRecord rec;
+	if ( !rec.open(ntfs, &ntfs->getmft(), MFT_RECNUM(sfrLogFile)) ) return 0;
+
+	CBlockStream *log = rec.openattribute(atDATA, L"", -1);
+	if ( !log ) return 0;
+	log->SetIOTag(iotagMFT);
+
+	UINT32 systempagesize = 0;
+	UINT64 lsn = restartlsn(log, 0, &systempagesize);
+	if ( systempagesize >= 512 )
+	{
+		UINT64 lsn2 = restartlsn(log, systempagesize, NULL);
+		if ( lsn2 > lsn ) lsn = lsn2;
+	}
+	delete log;
+	if ( lsn == 0 ) return 0;
+
+	if ( !rec.open(ntfs, &ntfs->getmft(), MFT_RECNUM(sfrMFT)) ) return 0;
+	CBlockStream *bm = rec.openattribute(atBITMAP, L"", -1);
+	if ( !bm ) return 0;
+	bm->SetIOTag(iotagBITMAP);
+
+	UINT64 hash = 14695981039346656037ULL;
+	for(int i = 0; i < 8; i++) { hash ^= (UINT8)(lsn >> (i * 8)); hash *= 1099511628211ULL; }
+
+	UINT8 buffer[4096];
+	INT64 pos = 0, length = bm->Length();
+	bool ok = true;
+	while ( ok && pos < length )
+	{
+		int n = (int)ad_min((INT64)sizeof(buffer), length - pos);
+		ok = bm->Read(buffer, n, pos) == n;
+		for(int i = 0; ok && i < n; i++) { hash ^= buffer[i]; hash *= 1099511628211ULL; }
+		pos += n;
+	}
+	delete bm;
+
+	if ( !ok ) return 0;
+	return hash != 0 ? hash : 1;
+}
+
+CNTFSClusterMap::CNTFSClusterMap()
+{
+	m_fingerprint = 0;
+	m_built = false;
+}
+
+CNTFSClusterMap::~CNTFSClusterMap()
+{
+	clear();
+}
+
+void CNTFSClusterMap::clear()
+{
+	m_extents.clear();
+	m_maxend.clear();
+	m_fingerprint = 0;
+	m_built = false;
+}
+
+// CClusterMapScan
+// Hands the in use records of a CMFT::scan() to CNTFSClusterMap::addrecord().
+class CClusterMapScan : public CMFTScanSink
+{
+public:
+	CClusterMapScan(CNTFSClusterMap &map, fssize_t clustercount) : m_map(map), m_clustercount(clustercount) {}
+
+	bool	record(INT64 recnum, SMFTRecord *rec, int recsize)	{ m_map.addrecord(rec, recnum, recsize, m_clustercount); return true; }
+private:
+	CNTFSClusterMap&	m_map;
+	fssize_t			m_clustercount;
+};
+
+bool CNTFSClusterMap::build(CNTFS *ntfs)
+{
+	clear();
+	if ( !ntfs || !ntfs->isvalid() ) return false;
+
+	// taken first, so changes made while we walk the mft make the saved map stale rather than trusted
+	m_fingerprint = volumefingerprint(ntfs);
+
+	CClusterMapScan sink(*this, ntfs->ftkbioBlockCount());
+	if ( !ntfs->getmft().scan(sink, CMFT::MFTSCAN_INUSE) ) { clear(); return false; }
+
+	finish();
+	return true;
+}
+
+void CNTFSClusterMap::addrecord(const SMFTRecord *crec, INT64 recnum, int recsize, fssize_t clustercount)
+{
+	SMFTRecord *rec = const_cast<SMFTRecord *>(crec);
+	const char *recend = ((const char *)rec) + recsize;
+
+	SClusterExtent e;
+	e.owner = rec->isbaserecord() ? MFT_RECNUM(rec->sequencenumber, recnum) : rec->baserecnum;
+
+	for(CMFTAttributeIterator it(rec, recsize); it.get(); it.next())
+	{
+		SMFTAttribute *fa = it.get();
+		if ( !fa->isnonresident() ) continue;
+
+		const NTFSfileruns *runs = fa->getruns();
+		if ( !runs || (const char *)runs >= recend ) continue;
+
+		e.attributetype = fa->attributetype;
+		e.attributeid = fa->identifier;
+
+		fssize_t vcn = fa->nr.startingvcn;
+		fssize_t lcn = 0;
+		fssize_t offset = 0, length = 0;
+		bool sparse;
+		for(const char *cp = runs->getfirstrun(offset, length, sparse); cp && cp < recend; cp = runs->getnextrun(offset, length, sparse, cp) )
+		{
+			lcn += offset;
+			if ( !sparse && length > 0 && lcn >= 0 && lcn + length <= clustercount )
+			{
+				// SClusterExtent::count is 32 bits, split anything bigger
+				for(fssize_t done = 0; done < length; )
+				{
+					fssize_t n = ad_min( length - done, (fssize_t)0xFFFFFFFF );
+					e.lcn = lcn + done;
+					e.vcn = vcn + done;
+					e.count = (UINT32)n;
+					m_extents.push_back(e);
+					done += n;
+				}
+			}
+			vcn += length;
+		}
+	}
+}
+
+void CNTFSClusterMap::finish()
+{
+	std::sort(m_extents.begin(), m_extents.end(), lcnorder);
+
+	m_maxend.resize(m_extents.size());
+	fssize_t maxend = 0;
+	for(unsigned int i = 0; i < m_extents.size(); i++)
+	{
+		if ( m_extents[i].end() > maxend ) maxend = m_extents[i].end();
+		m_maxend[i] = maxend;
+	}
+	m_built = true;
+}
+
+int CNTFSClusterMap::find(fssize_t cluster, vector<SClusterExtent> &owners) const
+{
+	return findrange(cluster, 1, owners);
+}
+
+int CNTFSClusterMap::findrange(fssize_t firstcluster, fssize_t count, vector<SClusterExtent> &owners) const
+{
+	if ( !isvalid() || count <= 0 || m_extents.empty() ) return 0;
+
+	// the last extent that starts inside the range
+	SClusterExtent key;
+	key.lcn = firstcluster + count - 1;
+	int i = (std::upper_bound(m_extents.begin(), m_extents.end(), key, lcnorder) - m_extents.begin()) - 1;
+
+	// walk back until nothing before can reach into the range
+	int found = 0;
+	for( ; i >= 0 && m_maxend[i] > firstcluster; i--)
+	{
+		if ( m_extents[i].end() > firstcluster )
+		{
+			owners.push_back( m_extents[i] );
+			found++;
+		}
+	}
+	return found;
+}
+
+bool CNTFSClusterMap::save(const CPath &filename, CNTFS *ntfs) const
+{
+	// there'd be no way to tell a later load() whether the volume has changed since
+	if ( !isvalid() || !ntfs || !ntfs->isvalid() || m_fingerprint == 0 ) return false;
+
+	FILE *fout = fopen(filename.str().c_str(), "wb");
+	if ( !fout ) return false;
+
+	SClusterMapFileHeader hdr;
+	memcpy(hdr.magic, CLUSTERMAPMAGIC, sizeof(hdr.magic));
+	hdr.volumeserialnumber = ntfs->getvolumeserialnumber();
+	hdr.clustercount = ntfs->ftkbioBlockCount();
+	hdr.recordcount = ntfs->getmft().recordcount();
+	hdr.fingerprint = m_fingerprint;
+	hdr.extentcount = m_extents.size();
+
+	bool result = fwrite(&hdr, sizeof(hdr), 1, fout) == 1;
+	if ( result && hdr.extentcount > 0 ) result = fwrite(&m_extents[0], sizeof(SClusterExtent), m_extents.size(), fout) == m_extents.size();
+
+	if ( fclose(fout) != 0 ) result = false;
+	if ( !result ) remove(filename.str().c_str());
+	return result;
+}
+
+bool CNTFSClusterMap::load(const CPath &filename, CNTFS *ntfs)
+{
+	clear();
+	if ( !ntfs || !ntfs->isvalid() ) return false;
+
+	UINT64 fingerprint = volumefingerprint(ntfs);
+	if ( fingerprint == 0 ) return false;
+
+	FILE *fin = fopen(filename.str().c_str(), "rb");
+	if ( !fin ) return false;
+
+	SClusterMapFileHeader hdr;
+	bool result = fread(&hdr, sizeof(hdr), 1, fin) == 1
+		&& memcmp(hdr.magic, CLUSTERMAPMAGIC, sizeof(hdr.magic)) == 0
+		&& hdr.volumeserialnumber == ntfs->getvolumeserialnumber()
+		&& hdr.clustercount == ntfs->ftkbioBlockCount()
+		&& hdr.recordcount == ntfs->getmft().recordcount()
+		&& hdr.fingerprint == fingerprint
+		&& hdr.extentcount >= 0;
+
+	if ( result && hdr.extentcount > 0 )
+	{
+		m_extents.resize( (unsigned int)hdr.extentcount );
+		result = fread(&m_extents[0], sizeof(SClusterExtent), m_extents.size(), fin) == m_extents.size();
+	}
+	fclose(fin);
+
+	if ( !result ) { clear(); return false; }
+
+	m_fingerprint = fingerprint;
+	finish();
+	return true;
+}
+
+}		// end namespace NTFS
+}		// end namespace AccessData
@@ -0,0 +1,125 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef NTFSCLUSTERMAP_H
+#define NTFSCLUSTERMAP_H
+
+#include "ADIOTypes.h"
+#include "MFT_RECNUM.h"
+#include "Path.h"
+#include <vector>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+using std::vector;
+
+// fwd defines
+class CNTFS;
+struct SMFTRecord;
+
+#pragma pack(push,1)
+// SClusterExtent
+// A run of clusters that belongs to a non-resident attribute.  Also the on-disk layout used by
+// CNTFSClusterMap::save(), so don't rearrange it.
+struct SClusterExtent
+{
+	fssize_t	lcn;				// the first cluster on the volume
+	fssize_t	vcn;				// the first cluster within the attribute
+	UINT32		count;				// clusters in the run
+	INT32		attributetype;		// see ENTFSFileAttributeTypes
+	MFT_RECNUM	owner;				// the file's base record, with its sequence number
+	UINT16		attributeid;		// the attribute's identifier, as used in the attribute list
+
+	fssize_t	end() const								{ return lcn + count; }
+	bool		contains(fssize_t cluster) const		{ return lcn <= cluster && cluster < end(); }
+};
+#pragma pack(pop)
+
+// CNTFSClusterMap
+// Maps volume clusters back to the files that use them.  Built with one pass over the
+// in-use MFT records, decoding the run list of every non-resident attribute, and kept
+// as a table sorted by cluster.  Point and range queries are a binary search plus a
+// walk back over any extents that overlap the result (there shouldn't be any on a
+// healthy volume).
+class CNTFSClusterMap
+{
+public:
+	CNTFSClusterMap();
+	~CNTFSClusterMap();
+
+	bool			isvalid() const			{ return m_built; }
+	void			clear();
+
+	bool			build(CNTFS *ntfs);
+
+	// save(), load()
+	// Stores / reloads the map.  The file carries a fingerprint of the volume taken when
+	// the map was built (the $LogFile's current LSN and a hash of the MFT record bitmap).
+	// load() fails if the file was made from a different volume, or from this one before
+	// it was last written to.  Without a fingerprint (no readable $LogFile restart page)
+	// save() refuses, so a map is never reloaded unchecked.
+	bool			save(const CPath &filename, CNTFS *ntfs) const;
+	bool			load(const CPath &filename, CNTFS *ntfs);
+
+	int				count() const			{ return m_extents.size(); }
+	const SClusterExtent&	operator[](int i) const		{ return m_extents[i]; }
+
+	// find()
+	// Adds the extents that hold cluster to owners.  Returns the number added, 0 if the cluster isn't used by any file.
+	int				find(fssize_t cluster, vector<SClusterExtent> &owners) const;
+	// findrange()
+	// Adds the extents that hold any of the clusters [firstcluster, firstcluster+count) to owners.  Returns the number added.
+	int				findrange(fssize_t firstcluster, fssize_t count, vector<SClusterExtent> &owners) const;
+protected:
+	friend class CClusterMapScan;
+
+	static bool		lcnorder(const SClusterExtent &a, const SClusterExtent &b)	{ return a.lcn < b.lcn; }
+
+	void			addrecord(const SMFTRecord *rec, INT64 recnum, int recsize, fssize_t clustercount);
+	void			finish();				// sort and fill in m_maxend
+
+	vector<SClusterExtent>	m_extents;		// sorted by lcn
+	vector<fssize_t>		m_maxend;		// m_maxend[i] is the largest end() of m_extents[0..i]
+	UINT64					m_fingerprint;	// the volume as of build() / load(), 0 if it couldn't be taken
+	bool					m_built;
+private:
+	CNTFSClusterMap(const CNTFSClusterMap &rhs);				// disallow
+	CNTFSClusterMap &operator=(const CNTFSClusterMap &rhs);	// disallow
+};
+
+}		// end namespace NTFS
+}		// end namespace AccessData
+
+#endif
@@ -0,0 +1,330 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "NTFSDeletedScan.h"
+#include "NTFS.h"
+#include "MFT.h"
+#include "MFTstructs.h"
+#include "NTFScommon.h"
+#include "BlockStream.h"
+#include "IOStats.h"
+
+#include <algorithm>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+CNTFSDeletedScan::CNTFSDeletedScan()
+{
+	m_ntfs = NULL;
+}
+
+CNTFSDeletedScan::~CNTFSDeletedScan()
+{
+	clear();
+}
+
+void CNTFSDeletedScan::clear()
+{
+	m_ntfs = NULL;
+	m_streams.clear();
+	m_extents.clear();
+	m_streamindex.clear();
+	m_baseseq.clear();
+}
+
+// CDeletedScanSink
+// Hands the records of a CMFT::scan() that aren't in use to CNTFSDeletedScan::addrecord().
+class CDeletedScanSink : public CMFTScanSink
+{
+public:
+	CDeletedScanSink(CNTFSDeletedScan &scan, fssize_t clustercount, vector<CNTFSDeletedScan::SRunRef> &runs)
+		: m_scan(scan), m_clustercount(clustercount), m_runs(runs) {}
+
+	bool	record(INT64 recnum, SMFTRecord *rec, int recsize)
+	{
+		if ( !rec->isinuse() ) m_scan.addrecord(rec, recnum, recsize, m_clustercount, m_runs);
+		return true;
+	}
+private:
+	CNTFSDeletedScan&					m_scan;
+	fssize_t							m_clustercount;
+	vector<CNTFSDeletedScan::SRunRef>&	m_runs;
+};
+
+bool CNTFSDeletedScan::run(CNTFS *ntfs)
+{
+	clear();
+	if ( !ntfs || !ntfs->isvalid() ) return false;
+
+	fssize_t clustercount = ntfs->ftkbioBlockCount();
+
+	// pass 1: collect the runs of every record that isn't in use
+	vector<SRunRef> runs;
+	CDeletedScanSink sink(*this, clustercount, runs);
+	if ( !ntfs->getmft().scan(sink) ) { clear(); return false; }
+	joinextensions(runs);
+	m_streamindex.clear();
+	m_baseseq.clear();
+
+	// pass 2: merge the runs against the volume bitmap
+	m_ntfs = ntfs;
+	mergeruns(runs, clustercount);
+	return true;
+}
+
+int CNTFSDeletedScan::findstream(MFT_RECNUM recnum, const wstring &name)
+{
+	StreamKey key(recnum.data, name);
+	map<StreamKey, int>::iterator it = m_streamindex.find(key);
+	if ( it != m_streamindex.end() ) return it->second;
+
+	SDeletedStream s;
+	s.recnum = recnum;
+	s.name = name;
+	s.length = -1;
+	s.firstextent = 0;
+	s.extentcount = 0;
+	s.recoverableclusters = 0;
+	s.overwrittenclusters = 0;
+	s.conflicts = 0;
+	m_streams.push_back(s);
+
+	int i = m_streams.size() - 1;
+	m_streamindex[key] = i;
+	return i;
+}
+
+void CNTFSDeletedScan::addrecord(SMFTRecord *rec, INT64 recnum, int recsize, fssize_t clustercount, vector<SRunRef> &runs)
+{
+	const char *recend = ((const char *)rec) + recsize;
+	MFT_RECNUM baserecnum = rec->isbaserecord() ? MFT_RECNUM(rec->sequencenumber, recnum) : rec->baserecnum;
+	if ( rec->isbaserecord() ) m_baseseq[recnum] = rec->sequencenumber;
+
+	for(CMFTAttributeIterator it(rec, recsize); it.get(); it.next())
+	{
+		SMFTAttribute *fa = it.get();
+		if ( fa->attributetype != atDATA || !fa->isnonresident() || fa->iscompressed() ) continue;
+
+		const NTFSfileruns *runlist = fa->getruns();
+		if ( !runlist || (const char *)runlist >= recend ) continue;
+		if ( fa->nameoffset + fa->namelength * sizeof(wchar_t) > fa->attributelength ) continue;
+
+		int s = findstream(baserecnum, fa->getname());
+		if ( fa->nr.startingvcn == 0 ) m_streams[s].length = fa->nr.streamlength_real;
+
+		SRunRef r;
+		r.stream = s;
+		r.vcn = fa->nr.startingvcn;
+		fssize_t lcn = 0;
+		fssize_t offset = 0, length = 0;
+		bool sparse;
+		for(const char *cp = runlist->getfirstrun(offset, length, sparse); cp && cp < recend; cp = runlist->getnextrun(offset, length, sparse, cp) )
+		{
+			lcn += offset;
+			if ( !sparse && length > 0 && lcn >= 0 && lcn + length <= clustercount )
+			{
+				r.lcn = lcn;
+				r.count = length;
+				runs.push_back(r);
+			}
+			r.vcn += length;
+		}
+	}
+}
+
+void CNTFSDeletedScan::joinextensions(vector<SRunRef> &runs)
+{
+	// An extension record names its base with the sequence number the base had when the extension
+	// was written.  If the base was freed after that, its own number is one higher.  Move those
+	// streams over to the base's, or fold them into it if it has the same stream.
+	vector<int> target(m_streams.size());
+	for(unsigned int i = 0; i < m_streams.size(); i++)
+	{
+		SDeletedStream &st = m_streams[i];
+		target[i] = i;
+
+		map<INT64, UINT16>::const_iterator base = m_baseseq.find(st.recnum.RecNum());
+		UINT16 next = st.recnum.SeqNum() + 1;
+		if ( next == 0 ) next = 1;		// 0 is never used as a sequence number
+		if ( base == m_baseseq.end() || base->second == st.recnum.SeqNum() || base->second != next ) continue;
+
+		MFT_RECNUM baserecnum(base->second, st.recnum.RecNum());
+		StreamKey key(baserecnum.data, st.name);
+		map<StreamKey, int>::iterator it = m_streamindex.find(key);
+		if ( it == m_streamindex.end() )
+		{
+			st.recnum = baserecnum;
+			m_streamindex[key] = i;
+		} else
+		{
+			target[i] = it->second;
+			if ( m_streams[it->second].length < 0 ) m_streams[it->second].length = st.length;
+		}
+	}
+
+	// drop the folded streams and renumber the rest
+	vector<int> newindex(m_streams.size());
+	vector<SDeletedStream> streams;
+	for(unsigned int i = 0; i < m_streams.size(); i++)
+	{
+		if ( target[i] != (int)i ) continue;
+		newindex[i] = streams.size();
+		streams.push_back(m_streams[i]);
+	}
+	for(unsigned int i = 0; i < m_streams.size(); i++)
+	{
+		newindex[i] = newindex[target[i]];
+	}
+	for(unsigned int i = 0; i < runs.size(); i++)
+	{
+		runs[i].stream = newindex[runs[i].stream];
+	}
+	m_streams.swap(streams);
+}
+
+void CNTFSDeletedScan::mergeruns(vector<SRunRef> &runs, fssize_t clustercount)
+{
+	std::sort(runs.begin(), runs.end(), lcnorder);
+
+	// The bitmap segments are only fetched for the parts of the volume the runs touch,
+	// so the table stays sorted and the walk through it only moves forward.
+	vector<SBitmapSegment> segments;
+	vector<SExtentRef> pieces;
+	pieces.reserve(runs.size());
+	unsigned int first = 0;
+
+	for(unsigned int i = 0; i < runs.size(); i++)
+	{
+		const SRunRef &r = runs[i];
+		fssize_t pos = r.lcn, end = r.lcn + r.count;
+
+		while ( first < segments.size() && segments[first].end <= pos ) first++;
+
+		for(unsigned int j = first; pos < end; )
+		{
+			if ( j == segments.size() )
+			{
+				SBitmapSegment seg;
+				seg.start = segments.empty() || segments.back().end < pos ? pos : segments.back().end;
+				fssize_t runlen = m_ntfs->getallocationrun(seg.start, clustercount - seg.start, seg.allocated);
+				if ( runlen <= 0 )
+				{
+					// can't read the bitmap, so don't trust the rest of the run
+					seg.end = end;
+					seg.allocated = true;
+				} else
+				{
+					seg.end = seg.start + runlen;
+				}
+				segments.push_back(seg);
+			}
+
+			const SBitmapSegment &seg = segments[j];
+			fssize_t n = ad_min(seg.end, end) - pos;
+
+			SExtentRef p;
+			p.stream = r.stream;
+			p.extent.vcn = r.vcn + (pos - r.lcn);
+			p.extent.lcn = pos;
+			p.extent.count = n;
+			p.extent.overwritten = seg.allocated;
+			p.extent.conflict = false;
+			pieces.push_back(p);
+
+			pos += n;
+			j++;
+		}
+	}
+	runs.clear();
+
+	// regroup the pieces by stream, in vcn order
+	std::sort(pieces.begin(), pieces.end(), streamorder);
+
+	// two fragments of the same stream that claim the same vcns can't both be right, so flag the later ones
+	m_extents.resize(pieces.size());
+	fssize_t vcnend = 0;
+	for(unsigned int i = 0; i < pieces.size(); i++)
+	{
+		SDeletedStream &s = m_streams[pieces[i].stream];
+		if ( s.extentcount == 0 )
+		{
+			s.firstextent = i;
+			vcnend = 0;
+		}
+		s.extentcount++;
+
+		pieces[i].extent.conflict = pieces[i].extent.vcn < vcnend;
+		if ( pieces[i].extent.conflict ) s.conflicts++;
+		if ( pieces[i].extent.vcn + pieces[i].extent.count > vcnend ) vcnend = pieces[i].extent.vcn + pieces[i].extent.count;
+		if ( pieces[i].extent.overwritten )
+			s.overwrittenclusters += pieces[i].extent.count;
+		else
+			s.recoverableclusters += pieces[i].extent.count;
+
+		m_extents[i] = pieces[i].extent;
+	}
+}
+
+CBlockStream* CNTFSDeletedScan::openstream(int i) const
+{
+	if ( !isvalid() || i < 0 || i >= streamcount() ) return NULL;
+
+	const SDeletedStream &s = m_streams[i];
+
+	CBlockStream *istream = new CBlockStream;
+	if ( !istream ) return NULL;
+	istream->SetDev( m_ntfs );
+	istream->SetInitialOffset( 0 );
+	istream->SetIOTag( iotagFILEDATA );
+	istream->SetAccessHint( iohintBULK );
+	m_ntfs->setreadahead(istream);
+
+	fssize_t vcn = 0;
+	for(int e = s.firstextent; e < s.firstextent + s.extentcount; e++)
+	{
+		const SDeletedExtent &x = m_extents[e];
+		if ( x.conflict ) continue;			// see SDeletedExtent
+
+		if ( x.vcn > vcn ) istream->AddRun(-1, x.vcn - vcn);
+		istream->AddRun(x.overwritten ? -1 : x.lcn, x.count);
+		vcn = x.vcn + x.count;
+	}
+
+	istream->SetLength( s.length >= 0 ? s.length : vcn * m_ntfs->ftkbioBlockSize() );
+	return istream;
+}
+
+}		// end namespace NTFS
+}		// end namespace AccessData
@@ -0,0 +1,160 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef NTFSDELETEDSCAN_H
+#define NTFSDELETEDSCAN_H
+
+#include "ADIOTypes.h"
+#include "MFT_RECNUM.h"
+#include "StringTypes.h"
+#include <vector>
+#include <map>
+
+namespace AccessData
+{
+
+class CBlockStream;
+
+namespace NTFS
+{
+
+using std::vector;
+using std::map;
+using std::pair;
+
+// fwd defines
+class CNTFS;
+struct SMFTRecord;
+
+// SDeletedExtent
+// A piece of a deleted stream.  overwritten is set when the clusters are allocated to
+// something else now, so their contents can't be trusted.
+struct SDeletedExtent
+{
+	fssize_t	vcn;				// the first cluster within the stream
+	fssize_t	lcn;				// the first cluster on the volume
+	fssize_t	count;
+	bool		overwritten;
+	bool		conflict;			// covers vcns an earlier extent of the same stream already did
+};
+
+// SDeletedStream
+// A data stream of an unused MFT record.  Its extents are
+// CNTFSDeletedScan::extent(firstextent) .. extent(firstextent+extentcount-1), in vcn order.
+struct SDeletedStream
+{
+	MFT_RECNUM	recnum;				// the base record, with the sequence number it had when the stream was seen
+	wstring		name;				// empty for the default stream
+	INT64		length;				// -1 if the first fragment of the attribute wasn't found
+	int			firstextent;
+	int			extentcount;
+	fssize_t	recoverableclusters;
+	fssize_t	overwrittenclusters;
+	int			conflicts;			// extents with the conflict flag set
+};
+
+// CNTFSDeletedScan
+// Finds the data streams of every unused MFT record and works out which of their
+// clusters are still free, in bulk.  One pass over the MFT collects the runs of the
+// unused records and sorts them by cluster.  Then they're merged against the volume
+// bitmap, which is read a segment at a time, only where the runs are, and only going
+// forward.  This replaces one bitmap lookup per run per file (see CMFTRecord::mergedeletedrun()).
+// Extension records are matched to their base record by record number and sequence
+// number.  Freeing a record bumps its sequence number, so a deleted base record's
+// extensions may name the one before it.  Extension records left over from an earlier
+// use of the record number become streams of their own.
+// Compressed streams are skipped, the same as CMFTRecord::openattribute() does.
+class CNTFSDeletedScan
+{
+public:
+	CNTFSDeletedScan();
+	~CNTFSDeletedScan();
+
+	bool			isvalid() const			{ return m_ntfs != NULL; }
+	void			clear();
+
+	bool			run(CNTFS *ntfs);
+
+	int						streamcount() const		{ return m_streams.size(); }
+	const SDeletedStream&	stream(int i) const		{ return m_streams[i]; }
+	const SDeletedExtent&	extent(int i) const		{ return m_extents[i]; }
+
+	// openstream()
+	// Builds a stream over the i'th deleted stream's recoverable clusters.  Overwritten
+	// clusters, and any holes, read as zeros.  Where extents conflict, the stream uses
+	// the one that comes first; check stream(i).conflicts before trusting it.
+	CBlockStream*	openstream(int i) const;
+protected:
+	friend class CDeletedScanSink;
+
+	struct SRunRef
+	{
+		fssize_t	lcn;
+		fssize_t	vcn;
+		fssize_t	count;
+		int			stream;			// index into m_streams
+	};
+	struct SExtentRef
+	{
+		int				stream;
+		SDeletedExtent	extent;
+	};
+	struct SBitmapSegment
+	{
+		fssize_t	start;
+		fssize_t	end;
+		bool		allocated;
+	};
+	static bool		lcnorder(const SRunRef &a, const SRunRef &b)			{ return a.lcn < b.lcn; }
+	static bool		streamorder(const SExtentRef &a, const SExtentRef &b)	{ return a.stream < b.stream || (a.stream == b.stream && a.extent.vcn < b.extent.vcn); }
+
+	typedef pair<INT64, wstring> StreamKey;		// (MFT_RECNUM(seq, recnum).data, name)
+
+	void			addrecord(SMFTRecord *rec, INT64 recnum, int recsize, fssize_t clustercount, vector<SRunRef> &runs);
+	void			mergeruns(vector<SRunRef> &runs, fssize_t clustercount);
+	void			joinextensions(vector<SRunRef> &runs);
+	int				findstream(MFT_RECNUM recnum, const wstring &name);
+
+	CNTFS*					m_ntfs;
+	vector<SDeletedStream>	m_streams;
+	vector<SDeletedExtent>	m_extents;
+	map<StreamKey, int>		m_streamindex;		// -> m_streams index, used while scanning
+	map<INT64, UINT16>		m_baseseq;			// recnum -> sequence number of the unused base records, used while scanning
+private:
+	CNTFSDeletedScan(const CNTFSDeletedScan &rhs);				// disallow
+	CNTFSDeletedScan &operator=(const CNTFSDeletedScan &rhs);	// disallow
+};
+
+}		// end namespace NTFS
+}		// end namespace AccessData
+
+#endif
@@ -142,7 +142,8 @@ bool CNTFSDirectory::read(CNTFS *ntfs, CStream *indexnodestream, NTFSindexentryl
 				{
 					//CFTKFileRef tempfileref( ntfs2ufid(0, ie->fileref.RecNum(), false) );
                     UINT64 mftrecnum = ie->fileref.RecNum();
-					CNTFSFile *f = ntfs->openfile(mftrecnum, 0, false);
+					// with the entry's sequence number, so a reused record is caught by the read we do anyway
+					CNTFSFile *f = ntfs->openfile(ie->fileref, 0, false);
 					if ( f )
 					{
                     	vector<UINT16> attribnums;
@@ -151,7 +152,8 @@ bool CNTFSDirectory::read(CNTFS *ntfs, CStream *indexnodestream, NTFSindexentryl
 							f->getdataattribnums( attribnums );
                             for(unsigned int i = 0; i < attribnums.size(); i++)
                             {
-                            	m_ufidlist.push_back( ntfs2ufid(attribnums[i], mftrecnum, false));
+                            	UFID_t ufid = ntfs2ufid(attribnums[i], mftrecnum, f->seqnum(), false);
+                            	if ( ufid != -1 ) m_ufidlist.push_back( ufid );
                             }
                         }
                         if ( (attribs & dsaDIRECTORY) == dsaDIRECTORY )
@@ -159,7 +161,8 @@ bool CNTFSDirectory::read(CNTFS *ntfs, CStream *indexnodestream, NTFSindexentryl
                         	f->getdirattribnums( attribnums );
                             for(unsigned int i = 0; i < attribnums.size(); i++)
                             {
-                            	m_ufidlist.push_back( ntfs2ufid(attribnums[i], mftrecnum, false));
+                            	UFID_t ufid = ntfs2ufid(attribnums[i], mftrecnum, f->seqnum(), false);
+                            	if ( ufid != -1 ) m_ufidlist.push_back( ufid );
                             }
                         }
 						delete f;
@@ -182,6 +185,9 @@ int CNTFSDirectory::getslackspace()
 	NTFSindexroot *indexroot = NTFSindexroot::Read(rootstream);
     if ( rootstream && indexroot && bmstream && indexnodestream )
     {
+		bmstream->SetIOTag(iotagBITMAP);
+		indexnodestream->SetIOTag(iotagINDEX);
+		indexnodestream->SetAccessHint(iohintMETADATA);
 		int blocksize = indexnodestream->PhysicalBlockSize();
         int indexnodesize = indexroot->indexnodesize;
         int nodecount = indexnodestream->Length() / indexnodesize;
@@ -237,6 +243,8 @@ CFile *CNTFSDirectory::FindFirst(const wstring &name, int attribs)
 	{
 		indexnodestream = m_file.openstream(m_ia_attribnum, false);
 		if ( !indexnodestream ) { free(indexroot); return NULL; }
+		indexnodestream->SetIOTag(iotagINDEX);
+		indexnodestream->SetAccessHint(iohintMETADATA);
 		blocksize = indexnodestream->PhysicalBlockSize();
 	}
 
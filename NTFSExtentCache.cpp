@@ -0,0 +1,277 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "NTFSExtentCache.h"
+#include "NTFScommon.h"
+
+#include <windows.h>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+#define EXTENTCACHE_DEFAULTMAXBYTES	(4*1024*1024)
+#define EXTENTCACHE_MINRUNS			4			// fewer runs than this are quicker to decode from the record
+
+void SExtentCacheStats::clear()
+{
+	hits = misses = stale = evictions = entries = bytes = 0;
+}
+
+CNTFSExtentCache::CNTFSExtentCache()
+{
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection(cs);
+	m_lock = cs;
+	m_tick = 0;
+	m_bytes = 0;
+	m_maxbytes = EXTENTCACHE_DEFAULTMAXBYTES;
+	m_stats.clear();
+}
+
+CNTFSExtentCache::~CNTFSExtentCache()
+{
+	clear();
+
+	CRITICAL_SECTION *cs = (CRITICAL_SECTION *)m_lock;
+	DeleteCriticalSection(cs);
+	delete cs;
+}
+
+void CNTFSExtentCache::lock()
+{
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+void CNTFSExtentCache::unlock()
+{
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+void CNTFSExtentCache::clear()
+{
+	lock();
+	m_entries.clear();
+	m_lru.clear();
+	m_tick = 0;
+	m_bytes = 0;
+	m_stats.clear();
+	unlock();
+}
+
+void CNTFSExtentCache::setmaxbytes(INT64 maxbytes)
+{
+	lock();
+	m_maxbytes = maxbytes;
+	while ( m_bytes > m_maxbytes && !m_lru.empty() )
+	{
+		dropentry( m_entries.find(m_lru.begin()->second) );
+		m_stats.evictions++;
+	}
+	unlock();
+}
+
+void CNTFSExtentCache::getstats(SExtentCacheStats &stats)
+{
+	lock();
+	stats = m_stats;
+	stats.entries = m_entries.size();
+	stats.bytes = m_bytes;
+	unlock();
+}
+
+void CNTFSExtentCache::dropentry(EntryMap::iterator it)
+{
+	m_bytes -= entrybytes(it->second);
+	m_lru.erase(it->second.tick);
+	m_entries.erase(it);
+}
+
+void CNTFSExtentCache::putvarint(vector<char> &dest, UINT64 value)
+{
+	while ( value >= 0x80 )
+	{
+		dest.push_back( (char)((value & 0x7F) | 0x80) );
+		value >>= 7;
+	}
+	dest.push_back( (char)value );
+}
+
+bool CNTFSExtentCache::getvarint(const char *&src, const char *end, UINT64 &value)
+{
+	value = 0;
+	for(int shift = 0; src < end && shift < 64; shift += 7)
+	{
+		UINT8 b = (UINT8)*src++;
+		value |= ((UINT64)(b & 0x7F)) << shift;
+		if ( (b & 0x80) == 0 ) return true;
+	}
+	return false;
+}
+
+bool CNTFSExtentCache::splitufid(UFID_t ufid, UFID_t &key, UINT16 &seqnum)
+{
+	UINT16 attribnum;
+	UINT64 recnum;
+	bool isslack;
+	if ( !ufid2ntfs(ufid, attribnum, recnum, seqnum, isslack) || seqnum == 0 ) return false;
+
+	key = ntfs2ufid(attribnum, recnum, 0, isslack);
+	return key != -1;
+}
+
+CBlockStream *CNTFSExtentCache::open(UFID_t ufid, CFTKBlockDevice *dev)
+{
+	UFID_t key;
+	UINT16 seqnum;
+	if ( !dev || !splitufid(ufid, key, seqnum) ) return NULL;
+
+	// copy the runs out so they're decoded without the lock held
+	vector<char> runs;
+	INT64 length = 0;
+
+	lock();
+	EntryMap::iterator it = m_entries.find(key);
+	if ( it == m_entries.end() )
+	{
+		m_stats.misses++;
+		unlock();
+		return NULL;
+	}
+	if ( it->second.seqnum != seqnum )
+	{
+		dropentry(it);
+		m_stats.stale++;
+		m_stats.misses++;
+		unlock();
+		return NULL;
+	}
+	m_lru.erase(it->second.tick);
+	it->second.tick = ++m_tick;
+	m_lru[it->second.tick] = key;
+	runs = it->second.runs;
+	length = it->second.length;
+	m_stats.hits++;
+	unlock();
+
+	CBlockStream *stream = new CBlockStream;
+	if ( !stream ) return NULL;
+	stream->SetDev(dev);
+	stream->SetInitialOffset(0);
+	stream->SetLength(length);
+
+	INT64 prevend = 0;
+	const char *src = runs.empty() ? NULL : &runs[0];
+	const char *end = src + runs.size();
+	while ( src < end )
+	{
+		UINT64 count, start;
+		if ( !getvarint(src, end, count) || !getvarint(src, end, start) )
+		{
+			delete stream;
+			return NULL;
+		}
+		if ( start == 0 )
+		{
+			stream->AddRun(-1, count);
+		} else
+		{
+			start--;
+			INT64 delta = (INT64)(start >> 1) ^ -(INT64)(start & 1);
+			stream->AddRun(prevend + delta, count);
+			prevend += delta + count;
+		}
+	}
+	return stream;
+}
+
+void CNTFSExtentCache::add(UFID_t ufid, CBlockStream *stream)
+{
+	UFID_t key;
+	UINT16 seqnum;
+	if ( !stream || stream->RunCount() < EXTENTCACHE_MINRUNS || !splitufid(ufid, key, seqnum) ) return;
+
+	SEntry entry;
+	entry.seqnum = seqnum;
+	entry.length = stream->Length();
+	entry.tick = 0;
+
+	INT64 prevend = 0;
+	for(int i = 0; i < stream->RunCount(); i++)
+	{
+		INT64 logicalstart, physicalstart, count;
+		if ( !stream->GetRunInfo(i, logicalstart, physicalstart, count) ) return;
+
+		putvarint(entry.runs, (UINT64)count);
+		if ( physicalstart == -1 )
+		{
+			putvarint(entry.runs, 0);
+		} else
+		{
+			INT64 delta = physicalstart - prevend;
+			putvarint(entry.runs, (((UINT64)delta << 1) ^ (UINT64)(delta >> 63)) + 1);
+			prevend = physicalstart + count;
+		}
+	}
+
+	INT64 bytes = entrybytes(entry);
+
+	lock();
+	if ( bytes > m_maxbytes )
+	{
+		unlock();
+		return;
+	}
+
+	EntryMap::iterator it = m_entries.find(key);
+	if ( it != m_entries.end() ) dropentry(it);
+
+	while ( m_bytes + bytes > m_maxbytes && !m_lru.empty() )
+	{
+		dropentry( m_entries.find(m_lru.begin()->second) );
+		m_stats.evictions++;
+	}
+
+	entry.tick = ++m_tick;
+	m_lru[entry.tick] = key;
+	SEntry &e = m_entries[key];
+	e.seqnum = entry.seqnum;
+	e.length = entry.length;
+	e.tick = entry.tick;
+	e.runs.swap(entry.runs);
+	m_bytes += bytes;
+	unlock();
+}
+
+}		// end namespace NTFS
+}		// end namespace AccessData
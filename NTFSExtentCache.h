@@ -0,0 +1,124 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef NTFSEXTENTCACHE_H
+#define NTFSEXTENTCACHE_H
+
+#include "ADIOTypes.h"
+#include "ADIOBlockDevice.h"
+#include "BlockStream.h"
+#include <vector>
+#include <map>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+using std::vector;
+using std::map;
+
+// SExtentCacheStats
+struct SExtentCacheStats
+{
+	INT64		hits;
+	INT64		misses;
+	INT64		stale;					// entries dropped because the record's sequence number changed
+	INT64		evictions;				// entries dropped to make room
+	INT64		entries;
+	INT64		bytes;					// what the entries are counted as against the limit
+
+	void		clear();
+};
+
+// CNTFSExtentCache
+// The run lists of files that have been opened on a volume, so opening the same file again
+// doesn't have to decode its runs (and for a file with an attribute list, load all of its
+// subrecords' runs) again.  Entries are keyed by UFID, less its sequence number, and hold the
+// runs as varints, deltas from the end of the run before, which for most files is a few bytes
+// a run.  Each entry remembers the sequence number from the UFID it was added with, and is
+// dropped if it's asked for with a different one, so a reused record doesn't leave its old
+// runs behind.  UFIDs without a sequence number aren't cached.  The least recently used
+// entries go once the limit is reached.
+// Safe to use from more than one thread.
+class CNTFSExtentCache
+{
+public:
+	CNTFSExtentCache();
+	~CNTFSExtentCache();
+
+	void			clear();								// drops every entry, keeps the limit
+	void			setmaxbytes(INT64 maxbytes);			// 0 turns the cache off
+
+	// open()
+	// Returns a new stream on dev built from the runs cached for ufid, or NULL if there aren't any.
+	CBlockStream*	open(UFID_t ufid, CFTKBlockDevice *dev);
+
+	// add()
+	// Remembers stream's runs for ufid.  Streams with only a few runs aren't worth keeping and are ignored.
+	void			add(UFID_t ufid, CBlockStream *stream);
+
+	void			getstats(SExtentCacheStats &stats);
+protected:
+	struct SEntry
+	{
+		UINT16			seqnum;
+		INT64			length;				// the stream's length in bytes
+		INT64			tick;				// key in m_lru
+		vector<char>	runs;				// count, then 0 for sparse or zigzag(start - previous end) + 1
+	};
+	typedef map<UFID_t, SEntry> EntryMap;
+
+	static void		putvarint(vector<char> &dest, UINT64 value);
+	static bool		getvarint(const char *&src, const char *end, UINT64 &value);
+	static INT64	entrybytes(const SEntry &entry)	{ return sizeof(SEntry) + entry.runs.size(); }
+	static bool		splitufid(UFID_t ufid, UFID_t &key, UINT16 &seqnum);
+	void			dropentry(EntryMap::iterator it);	// m_lock must be held
+	void			lock();
+	void			unlock();
+
+	EntryMap				m_entries;
+	map<INT64, UFID_t>		m_lru;			// oldest first
+	INT64					m_tick;
+	INT64					m_bytes;
+	INT64					m_maxbytes;
+	SExtentCacheStats		m_stats;
+	void*					m_lock;			// CRITICAL_SECTION, guards everything above
+private:
+	CNTFSExtentCache(const CNTFSExtentCache &rhs);				// disallow
+	CNTFSExtentCache &operator=(const CNTFSExtentCache &rhs);	// disallow
+};
+
+}		// end namespace NTFS
+}		// end namespace AccessData
+
+#endif
@@ -33,6 +33,7 @@
 #include "MFTstructs.h"
 #include "NTFScommon.h"
 #include "NTFSattributestructs.h"
+#include "NTFSParentGraph.h"
 #include "BlockStream.h"
 #include "RamStream.h"
 #include "SelfDestruct.h"
@@ -141,6 +142,15 @@ bool CNTFSFile::open(CNTFS *ntfs, CMFT *mft, MFT_RECNUM recnum, UINT16 attribnum
     {
     	m_filename = L""; // special case the root directory so we don't get "." as the filename
         m_pufid = -1;
+    } else if ( m_ntfs->m_parentgraph )
+    {
+    	// the parents have all been worked out already
+    	INT64 prec;
+    	UINT16 pseqnum, pa;
+    	if ( m_ntfs->m_parentgraph->getparent(m_baserecnum.RecNum(), prec, pseqnum, pa) )
+    		m_pufid = ntfs2ufid(pa, prec, pseqnum, false);
+    	else
+    		m_pufid = m_ntfs->orphandirufid();
     } else	// if ( precnum.RecNum() != m_baserecnum.RecNum() )
     {
 		m_pufid = m_ntfs->orphandirufid();
@@ -155,7 +165,7 @@ bool CNTFSFile::open(CNTFS *ntfs, CMFT *mft, MFT_RECNUM recnum, UINT16 attribnum
         {
             int pa = prec.findattribute(atINDEXROOT, NTFSFILENAMEINDEX, -1);
             if ( pa == -1 ) pa = prec.findattribute(atDATA, L"", -1);
-            if ( pa != -1 ) m_pufid = ntfs2ufid(pa, precnum.RecNum(), false);
+            if ( pa != -1 ) m_pufid = ntfs2ufid(pa, precnum.RecNum(), prec.seqnum(), false);
         }
     }
 
@@ -222,7 +232,26 @@ CBlockStream* CNTFSFile::openstream(UINT16 attribnum, bool slack)
 
 CBlockStream* CNTFSFile::Open()
 {
-	CBlockStream *s = openstream(m_attribnum, m_slack);
+	if ( !isvalid() ) return NULL;
+
+	// slack streams are cut out of the whole stream, and resident ones share the record, so only plain
+	// non-resident streams go through the extent cache
+	const SMFTAttribute *fa = m_mftrec.getattribute(m_attribnum, 0);
+	bool cacheable = !m_slack && fa && !fa->isresident();
+
+	CBlockStream *s = cacheable ? m_ntfs->m_extentcache.open(GetUFID(), m_ntfs) : NULL;
+	if ( !s )
+	{
+		s = openstream(m_attribnum, m_slack);
+		if ( s && cacheable ) m_ntfs->m_extentcache.add(GetUFID(), s);
+	}
+	if ( s )
+	{
+		// file contents are usually read once, start to end.  Callers that know better can change it.
+		s->SetIOTag(iotagFILEDATA);
+		s->SetAccessHint(iohintBULK);
+		m_ntfs->setreadahead(s);
+	}
 	if ( s && m_firstsector == -1 )
 	{
 		m_firstsector = s->GetBlock(0, NULL);
@@ -238,7 +267,7 @@ CBlockStream *CNTFSFile::OpenSlack()
 
 UFID_t CNTFSFile::GetUFID() const
 {
-	return ntfs2ufid(m_attribnum, m_baserecnum.RecNum(), m_slack);
+	return ntfs2ufid(m_attribnum, m_baserecnum.RecNum(), m_mftrec.seqnum(), m_slack);
 }
 
 UFID_t CNTFSFile::GetParentUFID() const
@@ -278,9 +307,10 @@ void CNTFSFile::GetPaths(vector<CPath> &paths) const
 
     UINT16 pattrib;
     UINT64 prec;
+    UINT16 pseqnum;
     bool pslack;
-    ufid2ntfs(m_pufid, pattrib, prec, pslack);
-    string parentdir = (m_baserecnum.RecNum() != sfrRootDir) ? w2s(m_ntfs->getfilename( prec )) : string("\\");
+    ufid2ntfs(m_pufid, pattrib, prec, pseqnum, pslack);
+    string parentdir = (m_baserecnum.RecNum() != sfrRootDir) ? w2s(m_ntfs->getfilename( MFT_RECNUM(pseqnum, prec) )) : string("\\");
     wstring fname;
 
     CPath temp;
@@ -445,12 +475,12 @@ bool CNTFSFile::ftkMetaDataListPopulate(CFTKMetaDataList &mdlist)
 	}
 
 	// Add the unique file id
-	mdlist.ftkmdAdd( CFTKMetaData(mdiUFID, ntfs2ufid(m_attribnum, m_baserecnum.RecNum(), m_slack) ) );
+	mdlist.ftkmdAdd( CFTKMetaData(mdiUFID, GetUFID()) );
 
 	// Add the parent ufid
 	if ( m_slack )															// if its slack, its parent is the non-slack version of the file
 	{
-		pufid = ntfs2ufid(m_attribnum, m_baserecnum.RecNum(), false);
+		pufid = ntfs2ufid(m_attribnum, m_baserecnum.RecNum(), m_mftrec.seqnum(), false);
 	}
 	else if ( isdatafork )													// if its a datafork, its parent is the atDATA attrib with name == "" or the atINDEXROOT attrib
 	{
@@ -469,7 +499,7 @@ bool CNTFSFile::ftkMetaDataListPopulate(CFTKMetaDataList &mdlist)
 				parentattrib = parentmftrec.findattribute(atINDEXROOT, NULL, -1);
 				if ( parentattrib != NULL )
 				{
-					pufid = ntfs2ufid(parentattrib, parentrec.RecNum(), false);
+					pufid = ntfs2ufid(parentattrib, parentrec.RecNum(), parentmftrec.seqnum(), false);
 				}
 			}
 		}
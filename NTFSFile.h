@@ -67,6 +67,7 @@ public:
     void			getdirattribnums(vector<UINT16> &dirattribs);
     bool			getdirattribnums(UINT16 &ir, UINT16 &ia, UINT16 &bm);
     CBlockStream*	openstream(UINT16 attribnum, bool slack);
+	UINT16			seqnum() const		{ return m_mftrec.seqnum(); }		// the base record's, as it's in the UFIDs
 
 	//
 	// inherited CFile methods
@@ -0,0 +1,340 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "NTFSIndexSlack.h"
+#include "NTFS.h"
+#include "NTFSBitmap.h"
+#include "NTFSindexstructs.h"
+#include "NTFSattributestructs.h"
+#include "MFT.h"
+#include "MFTstructs.h"
+#include "NTFScommon.h"
+#include "BlockStream.h"
+#include "IOStats.h"
+#include "WorkerPool.h"
+
+#include <windows.h>
+#include <malloc.h>
+#include <algorithm>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+#define NTFSFILENAMEINDEX			L"$I30"
+#define INDEXSLACK_CHUNKBYTES		(256*1024)		// index node bytes handed to a worker at a time
+
+#define INDEXENTRYHEADERSIZE		0x10			// NTFSindexentry up to data
+#define FILENAMEHEADERSIZE			0x42			// SFilenameAttrib up to filename
+#define INDEXNODELISTOFFSET			0x18			// NTFSindexnode::indexentries
+#define INDEXROOTLISTOFFSET			0x10			// NTFSindexroot::indexentries
+#define MAXFILETIME					0x0300000000000000LL	// well past 2100
+
+// SIndexSlackTask
+// Searches a run of index nodes from one directory
+class SIndexSlackTask : public CWorkerTask
+{
+public:
+	CNTFSIndexSlackCarver*	carver;
+	MFT_RECNUM				dir;
+	INT64					reccount;
+	INT64					firstnode;
+	int						nodecount;
+	int						nodesize;
+	int						blocksize;
+	char*					buffer;
+	vector<bool>			allocated;
+
+	~SIndexSlackTask() { free(buffer); }
+	void run();
+};
+
+void SIndexSlackTask::run()
+{
+	vector<SIndexSlackHit> hits;
+	for(int i = 0; i < nodecount; i++)
+	{
+		NTFSindexnode *node = (NTFSindexnode *)(buffer + i * nodesize);
+
+		// A free node may still have its header.  If not, search all of it.
+		int start = INDEXNODELISTOFFSET + sizeof(NTFSindexentrylist);
+		int end = nodesize;
+		bool live = node->isvalid() && node->fixuplistoffset + node->fixuplistcount * 2 <= nodesize && node->dofixup(nodesize, blocksize);
+		if ( live && node->indexentries.liststart < (UINT32)nodesize )
+		{
+			if ( allocated[i] )
+			{
+				start = INDEXNODELISTOFFSET + node->indexentries.listend;
+				end = INDEXNODELISTOFFSET + ad_min(node->indexentries.listsize, (UINT32)(nodesize - INDEXNODELISTOFFSET));
+			} else
+			{
+				start = INDEXNODELISTOFFSET + node->indexentries.liststart;
+			}
+		} else if ( allocated[i] )
+		{
+			continue;		// in use, but we can't make sense of it
+		}
+
+		CNTFSIndexSlackCarver::carve( (const char *)node, start, end, dir, firstnode + i, !allocated[i], reccount, hits );
+	}
+	carver->addhits(hits);
+}
+
+CNTFSIndexSlackCarver::CNTFSIndexSlackCarver()
+{
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection(cs);
+	m_lock = cs;
+}
+
+CNTFSIndexSlackCarver::~CNTFSIndexSlackCarver()
+{
+	clear();
+
+	CRITICAL_SECTION *cs = (CRITICAL_SECTION *)m_lock;
+	DeleteCriticalSection(cs);
+	delete cs;
+}
+
+void CNTFSIndexSlackCarver::clear()
+{
+	m_hits.clear();
+}
+
+static bool hitorder(const SIndexSlackHit &a, const SIndexSlackHit &b)
+{
+	if ( a.directory.data != b.directory.data ) return a.directory.RecNum() < b.directory.RecNum();
+	if ( a.node != b.node ) return a.node < b.node;
+	return a.offset < b.offset;
+}
+
+void CNTFSIndexSlackCarver::finish()
+{
+	// the workers finish in any order
+	std::sort(m_hits.begin(), m_hits.end(), hitorder);
+}
+
+void CNTFSIndexSlackCarver::addhits(vector<SIndexSlackHit> &hits)
+{
+	if ( hits.empty() ) return;
+
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+	m_hits.insert(m_hits.end(), hits.begin(), hits.end());
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+// CIndexSlackDirSink
+// Collects the in use directories from a CMFT::scan().
+class CIndexSlackDirSink : public CMFTScanSink
+{
+public:
+	CIndexSlackDirSink(vector<MFT_RECNUM> &dirs) : m_dirs(dirs) {}
+
+	bool	record(INT64 recnum, SMFTRecord *rec, int recsize)
+	{
+		if ( rec->isbaserecord() && rec->isdirectory() ) m_dirs.push_back( MFT_RECNUM(rec->sequencenumber, recnum) );
+		return true;
+	}
+private:
+	vector<MFT_RECNUM>&	m_dirs;
+};
+
+bool CNTFSIndexSlackCarver::scan(CNTFS *ntfs, int threads)
+{
+	clear();
+	if ( !ntfs || !ntfs->isvalid() ) return false;
+
+	// find the directories first, so the MFT reads aren't mixed in with the index reads
+	vector<MFT_RECNUM> dirs;
+	CIndexSlackDirSink sink(dirs);
+	if ( !ntfs->getmft().scan(sink, CMFT::MFTSCAN_INUSE) ) return false;
+
+	CWorkerPool pool;
+	pool.start(threads);
+	for(unsigned int i = 0; i < dirs.size(); i++)
+	{
+		carvedirectory(ntfs, dirs[i], pool);
+	}
+	pool.wait();
+
+	finish();
+	return true;
+}
+
+bool CNTFSIndexSlackCarver::scandirectory(CNTFS *ntfs, MFT_RECNUM dir, int threads)
+{
+	clear();
+	if ( !ntfs || !ntfs->isvalid() ) return false;
+
+	CWorkerPool pool;
+	pool.start(threads);
+	bool result = carvedirectory(ntfs, dir, pool);
+	pool.wait();
+
+	finish();
+	return result;
+}
+
+bool CNTFSIndexSlackCarver::carvedirectory(CNTFS *ntfs, MFT_RECNUM dir, CWorkerPool &pool)
+{
+	CMFTRecord rec;
+	if ( !rec.open(ntfs, &ntfs->getmft(), dir) ) return false;
+
+	// the directory's own reference, with the sequence number its entries use
+	dir = MFT_RECNUM( rec.seqnum(), dir.RecNum() );
+	INT64 reccount = ntfs->getmft().recordcount();
+
+	int ir = rec.findattribute(atINDEXROOT, NTFSFILENAMEINDEX, -1);
+	int ia = rec.findattribute(atINDEXALLOCATION, NTFSFILENAMEINDEX, -1);
+	int bmattrib = rec.findattribute(atBITMAP, NTFSFILENAMEINDEX, -1);
+	if ( ir < 0 ) return false;
+
+	CBlockStream *rootstream = rec.openattribute(ir);
+	NTFSindexroot *indexroot = NTFSindexroot::Read(rootstream);
+	int rootsize = rootstream ? (int)rootstream->Length() : 0;
+	delete rootstream;
+	if ( !indexroot ) return false;
+
+	// the root is small, do it here
+	vector<SIndexSlackHit> hits;
+	int rootend = ad_min( (int)(INDEXROOTLISTOFFSET + indexroot->indexentries.listsize), rootsize );
+	carve( (const char *)indexroot, INDEXROOTLISTOFFSET + indexroot->indexentries.listend, rootend, dir, -1, false, reccount, hits );
+	addhits(hits);
+
+	int nodesize = indexroot->indexnodesize;
+	free(indexroot);
+	if ( ia < 0 || bmattrib < 0 || nodesize <= 0 ) return true;		// small directory, no nodes
+
+	CBlockStream *indexnodestream = rec.openattribute(ia);
+	CBlockStream *bmstream = rec.openattribute(bmattrib);
+	if ( !indexnodestream || !bmstream )
+	{
+		delete indexnodestream;
+		delete bmstream;
+		return false;
+	}
+	// read straight through, without filling the pinned part of the cache with nodes nobody will look up
+	indexnodestream->SetIOTag(iotagINDEX);
+	indexnodestream->SetAccessHint(iohintBULK);
+	bmstream->SetIOTag(iotagBITMAP);
+
+	int blocksize = indexnodestream->PhysicalBlockSize();
+	INT64 nodecount = indexnodestream->Length() / nodesize;
+
+	CNTFSBitmap bm;
+	bm.open(bmstream, nodecount);
+
+	int chunknodes = INDEXSLACK_CHUNKBYTES / nodesize;
+	if ( chunknodes < 1 ) chunknodes = 1;
+	bool result = true;
+	for(INT64 first = 0; first < nodecount; first += chunknodes)
+	{
+		int count = (int)ad_min( (INT64)chunknodes, nodecount - first );
+
+		SIndexSlackTask *task = new SIndexSlackTask;
+		if ( !task ) { result = false; break; }
+		task->buffer = (char *)malloc(count * nodesize);
+		if ( !task->buffer ) { delete task; result = false; break; }
+
+		int got = indexnodestream->Read(task->buffer, count * nodesize, first * nodesize);
+		if ( got <= 0 ) { delete task; break; }
+
+		task->carver = this;
+		task->dir = dir;
+		task->reccount = reccount;
+		task->firstnode = first;
+		task->nodecount = got / nodesize;
+		task->nodesize = nodesize;
+		task->blocksize = blocksize;
+		task->allocated.resize(task->nodecount);
+		for(int i = 0; i < task->nodecount; i++) task->allocated[i] = bm[first + i];
+
+		pool.submit(task);
+	}
+	delete indexnodestream;
+	return result;
+}
+
+void CNTFSIndexSlackCarver::carve(const char *buffer, int start, int end, MFT_RECNUM dir, INT64 node, bool unallocatednode, INT64 reccount, vector<SIndexSlackHit> &hits)
+{
+	const INT64 parentref = dir.data;
+
+	// entries are 8 byte aligned, and their $FILE_NAME starts with the parent's reference
+	int pos = (start + 7) & ~7;
+	for( ; pos + INDEXENTRYHEADERSIZE + FILENAMEHEADERSIZE <= end; pos += 8)
+	{
+		if ( *(const INT64 *)(buffer + pos + INDEXENTRYHEADERSIZE) != parentref ) continue;
+
+		NTFSindexentry *ie = (NTFSindexentry *)(buffer + pos);
+		SFilenameAttrib &fna = ie->getfilenameattribute();
+		int avail = end - pos;
+		int namebytes = fna.filenamelength * sizeof(UINT16);
+
+		if ( ie->reclength & 7 ) continue;
+		if ( ie->reclength > avail ) continue;
+		if ( ie->flags > 3 ) continue;
+		if ( fna.filenamelength == 0 || fna.filenamespace > 3 ) continue;
+		if ( ie->datalength < FILENAMEHEADERSIZE + namebytes ) continue;
+		if ( INDEXENTRYHEADERSIZE + ie->datalength > ie->reclength ) continue;
+		if ( ie->fileref.RecNum() >= reccount ) continue;
+		if ( fna.createtime <= 0 || fna.createtime > MAXFILETIME || fna.lastmodtime <= 0 || fna.lastmodtime > MAXFILETIME ) continue;
+		if ( fna.filelength_logical < 0 || fna.filelength_physical < 0 ) continue;
+
+		const UINT16 *name = (const UINT16 *)fna.filename;
+		int c = 0;
+		while ( c < fna.filenamelength && name[c] >= 0x20 && name[c] != '/' && name[c] != '\\' ) c++;
+		if ( c < fna.filenamelength ) continue;
+
+		SIndexSlackHit h;
+		h.directory = dir;
+		h.fileref = ie->fileref;
+		h.node = node;
+		h.offset = pos;
+		h.unallocatednode = unallocatednode;
+		h.name = fna.getfilename();
+		h.filenamespace = fna.filenamespace;
+		h.createtime = fna.createtime;
+		h.lastmodtime = fna.lastmodtime;
+		h.filereclastmodtime = fna.filereclastmodtime;
+		h.accesstime = fna.accesstime;
+		h.filelength_logical = fna.filelength_logical;
+		h.filelength_physical = fna.filelength_physical;
+		h.flags = fna.flags;
+		hits.push_back(h);
+
+		pos += ie->reclength - 8;		// the next one can't start inside this one
+	}
+}
+
+}		// end namespace NTFS
+}		// end namespace AccessData
@@ -0,0 +1,114 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef NTFSINDEXSLACK_H
+#define NTFSINDEXSLACK_H
+
+#include "ADIOTypes.h"
+#include "MFT_RECNUM.h"
+#include "StringTypes.h"
+#include <vector>
+
+namespace AccessData
+{
+
+class CWorkerPool;
+
+namespace NTFS
+{
+
+using std::vector;
+
+// fwd defines
+class CNTFS;
+
+// SIndexSlackHit
+// A filename index entry found somewhere a directory isn't using any more.
+struct SIndexSlackHit
+{
+	MFT_RECNUM	directory;
+	MFT_RECNUM	fileref;			// the file the entry pointed to, which may have been reused since
+	INT64		node;				// the index node it was found in, -1 for the index root
+	int			offset;				// of the entry within the node (or the root's attribute)
+	bool		unallocatednode;	// the whole node was free, rather than just the end of it
+	wstring		name;
+	UINT8		filenamespace;
+	INT64		createtime;
+	INT64		lastmodtime;
+	INT64		filereclastmodtime;
+	INT64		accesstime;
+	INT64		filelength_logical;
+	INT64		filelength_physical;
+	INT64		flags;
+};
+
+// CNTFSIndexSlackCarver
+// Carves old $I30 entries out of the unused end of each index node (listend..listsize) and out
+// of the nodes the index bitmap says are free.  Every entry in a directory's index has that
+// directory as the parent in its $FILE_NAME, so candidates are found with one 64 bit compare
+// at each 8 byte boundary before the rest of the entry is checked.
+// The index nodes are read on the calling thread, and the nodes are searched on a CWorkerPool.
+class CNTFSIndexSlackCarver
+{
+public:
+	CNTFSIndexSlackCarver();
+	~CNTFSIndexSlackCarver();
+
+	void			clear();
+
+	// scan()
+	// Carves every directory on the volume.  threads is passed to CWorkerPool::start().
+	bool			scan(CNTFS *ntfs, int threads = -1);
+	bool			scandirectory(CNTFS *ntfs, MFT_RECNUM dir, int threads = -1);
+
+	int						hitcount() const	{ return m_hits.size(); }
+	const SIndexSlackHit&	hit(int i) const	{ return m_hits[i]; }
+
+	// carve()
+	// Searches buffer[start, end) for entries whose parent is dir.  Used by the worker tasks.
+	static void		carve(const char *buffer, int start, int end, MFT_RECNUM dir, INT64 node, bool unallocatednode, INT64 reccount, vector<SIndexSlackHit> &hits);
+	void			addhits(vector<SIndexSlackHit> &hits);
+protected:
+	bool			carvedirectory(CNTFS *ntfs, MFT_RECNUM dir, CWorkerPool &pool);
+	void			finish();
+
+	vector<SIndexSlackHit>	m_hits;
+	void*					m_lock;			// CRITICAL_SECTION, guards m_hits while the workers are running
+private:
+	CNTFSIndexSlackCarver(const CNTFSIndexSlackCarver &rhs);				// disallow
+	CNTFSIndexSlackCarver &operator=(const CNTFSIndexSlackCarver &rhs);	// disallow
+};
+
+}		// end namespace NTFS
+}		// end namespace AccessData
+
+#endif
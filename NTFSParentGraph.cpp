@@ -0,0 +1,333 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "NTFSParentGraph.h"
+#include "NTFS.h"
+#include "MFT.h"
+#include "MFTstructs.h"
+#include "NTFSattributestructs.h"
+#include "NTFScommon.h"
+
+#include <algorithm>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+#define NTFSFILENAMEINDEX L"$I30"
+
+// map filenamespace to desirablilty index, higher number being more desirable (the same as CMFTRecord::getfilename())
+static const int filenamespacedesirability[] = { 3, 2, 0, 1 };
+
+// orders record numbers by their parent, then by record number
+struct SParentOrder
+{
+	const vector<INT64> *parent;
+
+	SParentOrder(const vector<INT64> &p) : parent(&p) { }
+	bool operator()(INT64 a, INT64 b) const
+	{
+		INT64 pa = (*parent)[(unsigned int)a], pb = (*parent)[(unsigned int)b];
+		return pa < pb || (pa == pb && a < b);
+	}
+};
+
+CNTFSParentGraph::CNTFSParentGraph()
+{
+	m_built = false;
+}
+
+CNTFSParentGraph::~CNTFSParentGraph()
+{
+	clear();
+}
+
+void CNTFSParentGraph::clear()
+{
+	m_parent.clear();
+	m_attrib.clear();
+	m_seqnum.clear();
+	m_children.clear();
+	m_extnames.clear();
+	m_built = false;
+}
+
+// CParentGraphSink
+// Hands every record of a CMFT::scan() to CNTFSParentGraph::addrecord().
+class CParentGraphSink : public CMFTScanSink
+{
+public:
+	CParentGraphSink(CNTFSParentGraph &graph, vector<CNTFSParentGraph::SNode> &nodes) : m_graph(graph), m_nodes(nodes) {}
+
+	bool	record(INT64 recnum, SMFTRecord *rec, int recsize)	{ m_graph.addrecord(rec, recnum, recsize, m_nodes); return true; }
+private:
+	CNTFSParentGraph&					m_graph;
+	vector<CNTFSParentGraph::SNode>&	m_nodes;
+};
+
+bool CNTFSParentGraph::build(CNTFS *ntfs)
+{
+	clear();
+	if ( !ntfs || !ntfs->isvalid() ) return false;
+
+	INT64 reccount = ntfs->getmft().recordcount();
+
+	SNode empty;
+	empty.seqnum = 0;
+	empty.flags = 0;
+	empty.fnrank = -1;
+	vector<SNode> nodes( (unsigned int)reccount, empty );
+	m_parent.resize( (unsigned int)reccount, (INT64)NOTLISTED );
+	m_attrib.resize( (unsigned int)reccount, (UINT16)ATTRIBNONE );
+	m_seqnum.resize( (unsigned int)reccount, 0 );
+
+	// every record is read, in use or not, since deleted files need their deleted parents
+	CParentGraphSink sink(*this, nodes);
+	if ( !ntfs->getmft().scan(sink) ) { clear(); return false; }
+	joinextensions(nodes);
+	m_extnames.clear();
+
+	resolve(ntfs, nodes);
+	nodes.clear();
+	breakloops();
+
+	for(INT64 r = 0; r < reccount; r++)
+	{
+		if ( m_parent[(unsigned int)r] != NOTLISTED ) m_children.push_back(r);
+	}
+	std::sort(m_children.begin(), m_children.end(), SParentOrder(m_parent));
+
+	m_built = true;
+	return true;
+}
+
+void CNTFSParentGraph::addrecord(SMFTRecord *rec, INT64 recnum, int recsize, vector<SNode> &nodes)
+{
+	bool isbase = rec->isbaserecord();
+	INT64 baserecnum = isbase ? recnum : rec->baserecnum.RecNum();
+	if ( baserecnum < 0 || baserecnum >= (INT64)nodes.size() ) return;
+
+	SNode &node = nodes[(unsigned int)baserecnum];
+	if ( isbase )
+	{
+		node.seqnum = rec->sequencenumber;
+		node.flags |= nodeVALID;
+		if ( rec->isinuse() ) node.flags |= nodeINUSE;
+	}
+
+	// An extension record can outlive the file it was written for, so what it says about its
+	// base is held on to until joinextensions() can check it against the base.
+	SExtName ext;
+	ext.baserecnum = baserecnum;
+	ext.baseseqnum = rec->baserecnum.SeqNum();
+	ext.inuse = rec->isinuse();
+	ext.fnrank = -1;
+
+	int ir = -1, da = -1;
+	bool hasala = false;
+	for(CMFTAttributeIterator it(rec, recsize); it.get(); it.next())
+	{
+		SMFTAttribute *fa = it.get();
+		int attribnum = it.index();
+
+		switch ( fa->attributetype )
+		{
+			case atATTRIBUTELIST:
+				hasala = true;
+			break;
+			case atINDEXROOT:
+				if ( !isbase ) break;
+				node.flags |= nodeDIRECTORY;
+				if ( ir < 0 && fa->getname() == NTFSFILENAMEINDEX ) ir = attribnum;
+			break;
+			case atDATA:
+				if ( da < 0 && fa->namelength == 0 ) da = attribnum;
+			break;
+			case atFILENAME:
+			{
+				if ( !fa->isresident() || fa->r.streamoffset + sizeof(SFilenameAttrib) > fa->attributelength ) break;
+				SFilenameAttrib *fna = (SFilenameAttrib *)fa->residentstream();
+				if ( fna->filenamespace >= sizeof(filenamespacedesirability) / sizeof(filenamespacedesirability[0]) ) break;
+
+				int rank = filenamespacedesirability[fna->filenamespace];
+				if ( isbase && rank > node.fnrank )
+				{
+					node.fnrank = rank;
+					node.fnparent = fna->dirlocation;
+				}
+				else if ( !isbase && rank > ext.fnrank )
+				{
+					ext.fnrank = rank;
+					ext.fnparent = fna->dirlocation;
+				}
+			}
+			break;
+		}
+	}
+
+	if ( !isbase && ext.fnrank >= 0 ) m_extnames.push_back(ext);
+
+	// With an attribute list, CMFTRecord numbers the attributes in list order, which we can't
+	// tell from here.  resolve() opens the few of those that turn out to be parents.
+	if ( isbase )
+	{
+		if ( hasala )
+			m_attrib[(unsigned int)baserecnum] = ATTRIBUNKNOWN;
+		else if ( ir >= 0 )
+			m_attrib[(unsigned int)baserecnum] = ir;
+		else if ( da >= 0 )
+			m_attrib[(unsigned int)baserecnum] = da;
+	}
+}
+
+void CNTFSParentGraph::joinextensions(vector<SNode> &nodes)
+{
+	// Same rule as CNTFSDeletedScan::joinextensions(): an extension belongs to its base if the
+	// sequence numbers match, or if both are free and the base's is one past the extension's
+	// (freeing a record bumps its sequence number).  Anything else is left over from an older file.
+	for(unsigned int i = 0; i < m_extnames.size(); i++)
+	{
+		const SExtName &ext = m_extnames[i];
+		SNode &node = nodes[(unsigned int)ext.baserecnum];
+		if ( !(node.flags & nodeVALID) || ext.inuse != ((node.flags & nodeINUSE) != 0) ) continue;
+
+		UINT16 next = ext.baseseqnum + 1;
+		if ( next == 0 ) next = 1;		// 0 is never used as a sequence number
+		if ( node.seqnum != ext.baseseqnum && (ext.inuse || node.seqnum != next) ) continue;
+
+		if ( ext.fnrank > node.fnrank )
+		{
+			node.fnrank = ext.fnrank;
+			node.fnparent = ext.fnparent;
+		}
+	}
+}
+
+void CNTFSParentGraph::resolve(CNTFS *ntfs, vector<SNode> &nodes)
+{
+	INT64 reccount = nodes.size();
+	for(INT64 r = 0; r < reccount; r++)
+	{
+		const SNode &node = nodes[(unsigned int)r];
+		if ( !(node.flags & nodeVALID) || r == sfrRootDir ) continue;
+
+		m_parent[(unsigned int)r] = NOPARENT;
+		if ( node.fnrank < 0 ) continue;
+
+		INT64 p = node.fnparent.RecNum();
+		if ( p == r || p < 0 || p >= reccount ) continue;
+
+		// make sure the seq nums match or kinda match if its our deleted parent directory
+		const SNode &pnode = nodes[(unsigned int)p];
+		UINT16 origseqnum = node.fnparent.SeqNum();
+		bool deleted = !(node.flags & nodeINUSE);
+		bool pdeleted = !(pnode.flags & nodeINUSE);
+		if ( !(pnode.flags & nodeVALID) ) continue;
+		if ( !(pnode.seqnum == origseqnum || (deleted && pdeleted && (pnode.flags & nodeDIRECTORY) && pnode.seqnum == (UINT16)(origseqnum + 1))) ) continue;
+
+		UINT16 &pa = m_attrib[(unsigned int)p];
+		if ( pa == ATTRIBUNKNOWN )
+		{
+			CMFTRecord prec;
+			int i = -1;
+			if ( prec.open(ntfs, &ntfs->getmft(), MFT_RECNUM(0, p)) )
+			{
+				i = prec.findattribute(atINDEXROOT, NTFSFILENAMEINDEX, -1);
+				if ( i == -1 ) i = prec.findattribute(atDATA, L"", -1);
+			}
+			pa = i == -1 ? (UINT16)ATTRIBNONE : (UINT16)i;
+		}
+		if ( pa == ATTRIBNONE ) continue;
+
+		m_parent[(unsigned int)r] = p;
+		m_seqnum[(unsigned int)p] = pnode.seqnum;
+	}
+}
+
+void CNTFSParentGraph::breakloops()
+{
+	// 0 = not visited, 1 = on the path being walked, 2 = known to reach the root or an orphan
+	vector<UINT8> state(m_parent.size(), 0);
+
+	for(unsigned int r = 0; r < m_parent.size(); r++)
+	{
+		INT64 x = r;
+		while ( x >= 0 && state[(unsigned int)x] == 0 )
+		{
+			state[(unsigned int)x] = 1;
+			x = m_parent[(unsigned int)x];
+		}
+		if ( x >= 0 && state[(unsigned int)x] == 1 )
+			m_parent[(unsigned int)x] = NOPARENT;		// walked back onto our own path, cut the loop here
+
+		for(x = r; x >= 0 && state[(unsigned int)x] == 1; x = m_parent[(unsigned int)x])
+			state[(unsigned int)x] = 2;
+	}
+}
+
+bool CNTFSParentGraph::getparent(INT64 recnum, INT64 &parentrecnum, UINT16 &parentseqnum, UINT16 &parentattrib) const
+{
+	if ( !isvalid() || recnum < 0 || recnum >= recordcount() ) return false;
+
+	INT64 p = m_parent[(unsigned int)recnum];
+	if ( p < 0 ) return false;
+
+	parentrecnum = p;
+	parentseqnum = m_seqnum[(unsigned int)p];
+	parentattrib = m_attrib[(unsigned int)p];
+	return true;
+}
+
+int CNTFSParentGraph::getchildren(INT64 recnum, vector<INT64> &children) const
+{
+	if ( !isvalid() ) return 0;
+
+	// find the first child of recnum
+	unsigned int lo = 0, hi = m_children.size();
+	while ( lo < hi )
+	{
+		unsigned int mid = (lo + hi) / 2;
+		if ( m_parent[(unsigned int)m_children[mid]] < recnum ) lo = mid + 1; else hi = mid;
+	}
+
+	int found = 0;
+	for( ; lo < m_children.size() && m_parent[(unsigned int)m_children[lo]] == recnum; lo++)
+	{
+		children.push_back(m_children[lo]);
+		found++;
+	}
+	return found;
+}
+
+}		// end namespace NTFS
+}		// end namespace AccessData
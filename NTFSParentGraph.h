@@ -0,0 +1,125 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef NTFSPARENTGRAPH_H
+#define NTFSPARENTGRAPH_H
+
+#include "ADIOTypes.h"
+#include "MFT_RECNUM.h"
+#include <vector>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+using std::vector;
+
+// fwd defines
+class CNTFS;
+struct SMFTRecord;
+
+// CNTFSParentGraph
+// The parent directory of every base record in the MFT, in use or not, worked out in bulk.
+// One pass over the MFT picks up each record's $FILE_NAME parent reference, sequence number and
+// directory attribute (a $FILE_NAME in an extension record only counts if the extension still
+// belongs to that base), and then the parents are matched with the same rules CNTFSFile::open()
+// uses one file at a time: the parent's sequence number has to match the reference, or for a
+// deleted file, the parent can be a deleted directory whose sequence number is one past it.
+// Anything that doesn't match, or that would make a loop, is an orphan.
+class CNTFSParentGraph
+{
+public:
+	CNTFSParentGraph();
+	~CNTFSParentGraph();
+
+	bool			isvalid() const			{ return m_built; }
+	void			clear();
+
+	bool			build(CNTFS *ntfs);
+
+	INT64			recordcount() const		{ return m_parent.size(); }
+
+	// getparent()
+	// Returns true and sets the parent's record number, and the sequence number and attribute index to
+	// use for its UFID, if recnum has a parent, false if it's an orphan, the root, or not a base record at all.
+	bool			getparent(INT64 recnum, INT64 &parentrecnum, UINT16 &parentseqnum, UINT16 &parentattrib) const;
+
+	// getchildren() / getorphans()
+	// Adds the records whose parent is recnum (or that don't have one) to children.  Returns how many were added.
+	int				getchildren(INT64 recnum, vector<INT64> &children) const;
+	int				getorphans(vector<INT64> &orphans) const		{ return getchildren(NOPARENT, orphans); }
+protected:
+	friend class CParentGraphSink;
+
+	enum { NOPARENT = -1, NOTLISTED = -2 };		// NOTLISTED is the root, extension records and anything that isn't a record
+	enum { ATTRIBNONE = 0xFFFF, ATTRIBUNKNOWN = 0xFFFE };
+	enum { nodeVALID = 1, nodeINUSE = 2, nodeDIRECTORY = 4 };
+
+	// what's gathered for each record during the MFT pass, thrown away once the parents are resolved
+	struct SNode
+	{
+		MFT_RECNUM	fnparent;			// from the most descriptive $FILE_NAME
+		UINT16		seqnum;
+		UINT8		flags;
+		INT8		fnrank;				// how descriptive fnparent's filename is, -1 if none was found yet
+	};
+	// a $FILE_NAME found in an extension record, only used once it's known to still belong to its base
+	struct SExtName
+	{
+		INT64		baserecnum;
+		MFT_RECNUM	fnparent;
+		UINT16		baseseqnum;			// the base's sequence number as the extension has it
+		bool		inuse;
+		INT8		fnrank;
+	};
+
+	void			addrecord(SMFTRecord *rec, INT64 recnum, int recsize, vector<SNode> &nodes);
+	void			joinextensions(vector<SNode> &nodes);
+	void			resolve(CNTFS *ntfs, vector<SNode> &nodes);
+	void			breakloops();
+
+	vector<INT64>	m_parent;			// per record: the parent's record number, NOPARENT or NOTLISTED
+	vector<UINT16>	m_attrib;			// per record: the attribute index its children's parent UFIDs use
+	vector<UINT16>	m_seqnum;			// per record: its sequence number, for the same
+	vector<INT64>	m_children;			// every listed record, sorted by parent (orphans first)
+	vector<SExtName> m_extnames;		// used while scanning
+	bool			m_built;
+private:
+	CNTFSParentGraph(const CNTFSParentGraph &rhs);				// disallow
+	CNTFSParentGraph &operator=(const CNTFSParentGraph &rhs);	// disallow
+};
+
+}		// end namespace NTFS
+}		// end namespace AccessData
+
+#endif
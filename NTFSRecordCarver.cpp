@@ -0,0 +1,323 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "NTFSRecordCarver.h"
+#include "NTFS.h"
+#include "MFTstructs.h"
+#include "NTFScommon.h"
+#include "BlockStream.h"
+#include "RamStream.h"
+#include "ADIOFile.h"
+#include "IOStats.h"
+#include "WorkerPool.h"
+
+#include <windows.h>
+#include <malloc.h>
+#include <string.h>
+#include <algorithm>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+#define RECORDCARVER_CHUNKBYTES		(1024*1024)		// bytes of an extent handed to a worker at a time
+
+#define MFTRECORDHEADERSIZE			0x2A			// SMFTRecord up to the end of maxattribid
+#define MFTRECORDNUMOFFSET			0x2C			// where XP and later keep the record's own number
+#define RESIDENTHEADERSIZE			0x18			// SMFTAttribute up to the end of r
+#define NONRESIDENTHEADERSIZE		0x40			// SMFTAttribute up to the end of nr
+
+// SRecordCarveTask
+// Searches part of one extent of the unallocated stream
+class SRecordCarveTask : public CWorkerTask
+{
+public:
+	CNTFSRecordCarver*	carver;
+	fssize_t			cluster;		// where buffer starts
+	int					clustersize;
+	int					recsize;
+	int					blocksize;
+	int					stride;
+	int					searchlength;	// records may start in buffer[0, searchlength)
+	int					length;			// but can run on up to here
+	char*				buffer;
+
+	~SRecordCarveTask() { free(buffer); }
+	void run();
+};
+
+void SRecordCarveTask::run()
+{
+	vector<SCarvedRecord> locations;
+	vector<char> records;
+
+	for(int pos = 0; pos < searchlength && pos + recsize <= length; pos += stride)
+	{
+		if ( *(const INT32 *)(buffer + pos) != SMFTRecord::RECSIG ) continue;
+
+		// fix up a copy, so a bad candidate can't spoil one that overlaps it
+		unsigned int at = records.size();
+		records.resize(at + recsize);
+		SMFTRecord *rec = (SMFTRecord *)&records[at];
+		memcpy(rec, buffer + pos, recsize);
+		if ( !CNTFSRecordCarver::checkrecord(rec, recsize, blocksize) )
+		{
+			records.resize(at);
+			continue;
+		}
+
+		SCarvedRecord loc;
+		loc.cluster = cluster + pos / clustersize;
+		loc.offset = pos % clustersize;
+		loc.recnum = rec->fixuplistoffset >= MFTRECORDNUMOFFSET + 4 ? *(UINT32 *)(((char *)rec) + MFTRECORDNUMOFFSET) : -1;
+		locations.push_back(loc);
+	}
+	carver->addrecords(locations, records);
+}
+
+CNTFSRecordCarver::CNTFSRecordCarver()
+{
+	m_ntfs = NULL;
+	m_recsize = 0;
+
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection(cs);
+	m_lock = cs;
+}
+
+CNTFSRecordCarver::~CNTFSRecordCarver()
+{
+	clear();
+
+	CRITICAL_SECTION *cs = (CRITICAL_SECTION *)m_lock;
+	DeleteCriticalSection(cs);
+	delete cs;
+}
+
+void CNTFSRecordCarver::clear()
+{
+	m_ntfs = NULL;
+	m_recsize = 0;
+	m_locations.clear();
+	m_records.clear();
+}
+
+bool CNTFSRecordCarver::checkrecord(SMFTRecord *rec, int recsize, int blocksize)
+{
+	if ( !rec->isvalid() || blocksize <= 0 ) return false;
+
+	// the header
+	if ( (int)rec->recordlength_allocated != recsize ) return false;
+	if ( rec->recordlength_used > rec->recordlength_allocated ) return false;
+	if ( rec->fixuplistcount != recsize / blocksize + 1 ) return false;
+	if ( rec->fixuplistoffset < MFTRECORDHEADERSIZE || (rec->fixuplistoffset & 1) ) return false;
+	if ( rec->fixuplistoffset + rec->fixuplistcount * 2 > rec->attributeoffset ) return false;
+	if ( (rec->attributeoffset & 7) || rec->attributeoffset + 4 > rec->recordlength_used ) return false;
+
+	if ( !rec->dofixup(blocksize) ) return false;
+
+	// the attributes have to be in order and end with atEND, inside the used part of the record
+	const char *recend = ((const char *)rec) + rec->recordlength_used;
+	INT32 prevtype = 0;
+	int count = 0;
+	for(SMFTAttribute *fa = rec->getfirstattribute(); fa != NULL; fa = rec->getnextattribute(fa) )
+	{
+		if ( ((const char *)fa) + 4 > recend ) return false;
+		if ( fa->attributetype == atEND ) return count > 0;
+		if ( fa->attributetype < prevtype || (fa->attributetype & 0x0F) ) return false;
+		prevtype = fa->attributetype;
+
+		if ( fa->attributelength < RESIDENTHEADERSIZE || (fa->attributelength & 7) ) return false;
+		if ( ((const char *)fa) + fa->attributelength > recend ) return false;
+		if ( fa->nonresidentflag > 1 ) return false;
+		if ( fa->namelength && fa->nameoffset + fa->namelength * 2 > fa->attributelength ) return false;
+
+		if ( fa->isresident() )
+		{
+			if ( fa->r.streamoffset + fa->r.streamlength > fa->attributelength ) return false;
+		} else
+		{
+			if ( fa->attributelength < NONRESIDENTHEADERSIZE || fa->nr.runlistoffset >= fa->attributelength ) return false;
+			if ( fa->nr.lastvcn + 1 < fa->nr.startingvcn ) return false;
+		}
+		count++;
+	}
+	return false;
+}
+
+void CNTFSRecordCarver::addrecords(const vector<SCarvedRecord> &locations, const vector<char> &records)
+{
+	if ( locations.empty() ) return;
+
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+	m_locations.insert(m_locations.end(), locations.begin(), locations.end());
+	m_records.insert(m_records.end(), records.begin(), records.end());
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+struct SCarvedOrder
+{
+	const vector<SCarvedRecord> *locations;
+
+	SCarvedOrder(const vector<SCarvedRecord> &l) : locations(&l) { }
+	bool operator()(int a, int b) const
+	{
+		const SCarvedRecord &la = (*locations)[a], &lb = (*locations)[b];
+		return la.cluster < lb.cluster || (la.cluster == lb.cluster && la.offset < lb.offset);
+	}
+};
+
+void CNTFSRecordCarver::finish()
+{
+	// the workers finish in any order, put the records back in volume order
+	vector<int> order(m_locations.size());
+	for(unsigned int i = 0; i < order.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), SCarvedOrder(m_locations));
+
+	vector<SCarvedRecord> locations(m_locations.size());
+	vector<char> records(m_records.size());
+	for(unsigned int i = 0; i < order.size(); i++)
+	{
+		locations[i] = m_locations[order[i]];
+		memcpy(&records[i * m_recsize], &m_records[order[i] * m_recsize], m_recsize);
+	}
+	m_locations.swap(locations);
+	m_records.swap(records);
+}
+
+bool CNTFSRecordCarver::scan(CNTFS *ntfs, int threads)
+{
+	clear();
+	if ( !ntfs || !ntfs->isvalid() ) return false;
+
+	CFile *unalloc = ntfs->OpenFile( ntfs->GetUnallocUFID() );
+	CBlockStream *stream = unalloc ? unalloc->Open() : NULL;
+	delete unalloc;
+	if ( !stream ) return false;
+
+	m_ntfs = ntfs;
+	m_recsize = ntfs->getmft().recordsize();
+	int clustersize = ntfs->ftkbioBlockSize();
+	int blocksize = stream->PhysicalBlockSize();
+	int stride = ad_min(m_recsize, clustersize);
+	if ( m_recsize <= 0 || clustersize <= 0 || blocksize <= 0 ) { delete stream; clear(); return false; }
+
+	// whole clusters per chunk, plus enough of the next to finish the last record
+	INT64 chunkclusters = RECORDCARVER_CHUNKBYTES / clustersize;
+	if ( chunkclusters < 1 ) chunkclusters = 1;
+	int overlapclusters = div_roundup(m_recsize, clustersize) - 1;
+
+	CWorkerPool pool;
+	pool.start(threads);
+
+	INT64 logicalstart, physicalstart, count;
+	for(int r = 0; r < stream->RunCount() && stream->GetRunInfo(r, logicalstart, physicalstart, count); r++)
+	{
+		if ( physicalstart == -1 ) continue;
+
+		for(INT64 c = 0; c < count; c += chunkclusters)
+		{
+			INT64 searchclusters = ad_min(chunkclusters, count - c);
+			INT64 readclusters = ad_min(searchclusters + overlapclusters, count - c);
+
+			SRecordCarveTask *task = new SRecordCarveTask;
+			if ( !task ) break;
+			task->buffer = (char *)malloc( (size_t)(readclusters * clustersize) );
+			if ( !task->buffer ) { delete task; break; }
+
+			int got = stream->Read(task->buffer, (int)(readclusters * clustersize), (logicalstart + c) * clustersize);
+			if ( got <= 0 ) { delete task; continue; }
+
+			task->carver = this;
+			task->cluster = physicalstart + c;
+			task->clustersize = clustersize;
+			task->recsize = m_recsize;
+			task->blocksize = blocksize;
+			task->stride = stride;
+			task->searchlength = (int)ad_min( (INT64)got, searchclusters * clustersize );
+			task->length = got;
+			pool.submit(task);
+		}
+	}
+	pool.wait();
+	delete stream;
+
+	finish();
+	return true;
+}
+
+CBlockStream* CNTFSRecordCarver::openattribute(int i, int attributetype, const wchar_t *name)
+{
+	if ( !isvalid() || i < 0 || i >= recordcount() ) return NULL;
+
+	SMFTAttribute *fa = record(i)->findattribute(attributetype, name, -1, 0);
+	if ( !fa || fa->iscompressed() ) return NULL;
+
+	if ( fa->isresident() )
+	{
+		CRamBlockStream *ramstream = new CRamBlockStream;
+		if ( !ramstream ) return NULL;
+		ramstream->SetDev( m_ntfs );
+		ramstream->setbuffer( fa->residentstream(), fa->r.streamlength );
+		return ramstream;
+	}
+
+	// the rest of the attribute would be in other records, which we don't know
+	if ( fa->nr.startingvcn != 0 ) return NULL;
+
+	const NTFSfileruns *runs = fa->getruns();
+	if ( !runs ) return NULL;
+
+	CBlockStream *istream = new CBlockStream;
+	if ( !istream ) return NULL;
+	istream->SetDev( m_ntfs );
+	istream->SetInitialOffset( 0 );
+	istream->SetIOTag( iotagFILEDATA );
+	istream->SetAccessHint( iohintBULK );
+	m_ntfs->setreadahead(istream);
+
+	const char *recend = ((const char *)record(i)) + m_recsize;
+	fssize_t lcn = 0;
+	fssize_t offset = 0, length = 0;
+	bool sparse;
+	for(const char *cp = runs->getfirstrun(offset, length, sparse); cp && cp < recend; cp = runs->getnextrun(offset, length, sparse, cp) )
+	{
+		lcn += offset;
+		istream->AddRun( sparse ? -1 : lcn, length );
+	}
+	istream->SetLength( fa->nr.streamlength_real );
+	return istream;
+}
+
+}		// end namespace NTFS
+}		// end namespace AccessData
@@ -0,0 +1,111 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef NTFSRECORDCARVER_H
+#define NTFSRECORDCARVER_H
+
+#include "ADIOTypes.h"
+#include <vector>
+
+namespace AccessData
+{
+
+class CBlockStream;
+
+namespace NTFS
+{
+
+using std::vector;
+
+// fwd defines
+class CNTFS;
+struct SMFTRecord;
+
+// SCarvedRecord
+// Where a carved MFT record was found
+struct SCarvedRecord
+{
+	fssize_t	cluster;			// the cluster it starts in
+	int			offset;				// bytes into that cluster
+	INT64		recnum;				// the record number it had, if the record says (XP and later), otherwise -1
+};
+
+// CNTFSRecordCarver
+// Finds FILE records left in the unallocated clusters of a volume, say after a format or when the
+// MFT itself is damaged, and keeps them as a virtual MFT.  The unallocated stream is searched one
+// extent at a time, only at the places a record could start (every record size or cluster, which
+// ever is smaller).  Anything with the signature is fixed up and has its attribute chain checked
+// before it's kept.  The extents are read on the calling thread and searched on a CWorkerPool.
+class CNTFSRecordCarver
+{
+public:
+	CNTFSRecordCarver();
+	~CNTFSRecordCarver();
+
+	bool			isvalid() const			{ return m_ntfs != NULL; }
+	void			clear();
+
+	// scan()
+	// threads is passed to CWorkerPool::start()
+	bool			scan(CNTFS *ntfs, int threads = -1);
+
+	int						recordcount() const		{ return m_locations.size(); }
+	const SCarvedRecord&	location(int i) const	{ return m_locations[i]; }
+	SMFTRecord*				record(int i)			{ return (SMFTRecord *)&m_records[i * m_recsize]; }
+	int						recordsize() const		{ return m_recsize; }
+
+	// openattribute()
+	// Builds a stream over an attribute of the i'th record.  Only attributes that are entirely in
+	// that record can be opened, and the clusters of non-resident ones may have been reused since.
+	CBlockStream*	openattribute(int i, int attributetype, const wchar_t *name);
+
+	// checkrecord()
+	// Fixes up a candidate record in place and checks that it hangs together.  Used by the worker tasks.
+	static bool		checkrecord(SMFTRecord *rec, int recsize, int blocksize);
+	void			addrecords(const vector<SCarvedRecord> &locations, const vector<char> &records);
+protected:
+	void			finish();
+
+	CNTFS*					m_ntfs;
+	int						m_recsize;
+	vector<SCarvedRecord>	m_locations;
+	vector<char>			m_records;		// recordcount() records, m_recsize bytes each, already fixed up
+	void*					m_lock;			// CRITICAL_SECTION, guards the vectors while the workers are running
+private:
+	CNTFSRecordCarver(const CNTFSRecordCarver &rhs);				// disallow
+	CNTFSRecordCarver &operator=(const CNTFSRecordCarver &rhs);	// disallow
+};
+
+}		// end namespace NTFS
+}		// end namespace AccessData
+
+#endif
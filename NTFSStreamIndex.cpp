@@ -0,0 +1,277 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "NTFSStreamIndex.h"
+#include "NTFS.h"
+#include "MFT.h"
+#include "MFTstructs.h"
+#include "NTFScommon.h"
+#include "ADIOString.h"
+
+#include <wctype.h>
+#include <algorithm>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+static bool entryorder(const SStreamIndexEntry &a, const SStreamIndexEntry &b)
+{
+	if ( a.recnum.RecNum() != b.recnum.RecNum() ) return a.recnum.RecNum() < b.recnum.RecNum();
+	return a.attribnum < b.attribnum;
+}
+
+CNTFSStreamIndex::CNTFSStreamIndex()
+{
+	m_built = false;
+}
+
+CNTFSStreamIndex::~CNTFSStreamIndex()
+{
+	clear();
+}
+
+void CNTFSStreamIndex::clear()
+{
+	m_entries.clear();
+	m_pending.clear();
+	m_sizes.clear();
+	m_buckets.clear();
+	m_next.clear();
+	m_built = false;
+}
+
+// CStreamIndexSink
+// Hands every record of a CMFT::scan() to CNTFSStreamIndex::addrecord().
+class CStreamIndexSink : public CMFTScanSink
+{
+public:
+	CStreamIndexSink(CNTFSStreamIndex &index, vector<INT64> &openlater) : m_index(index), m_openlater(openlater) {}
+
+	bool	record(INT64 recnum, SMFTRecord *rec, int recsize)	{ m_index.addrecord(rec, recnum, recsize, m_openlater); return true; }
+private:
+	CNTFSStreamIndex&	m_index;
+	vector<INT64>&		m_openlater;
+};
+
+bool CNTFSStreamIndex::build(CNTFS *ntfs)
+{
+	clear();
+	if ( !ntfs || !ntfs->isvalid() ) return false;
+
+	vector<INT64> openlater;
+	CStreamIndexSink sink(*this, openlater);
+	if ( !ntfs->getmft().scan(sink) ) { clear(); return false; }
+
+	// fill in the streams that were named in attribute lists
+	for(map<INT64, int>::iterator it = m_pending.begin(); it != m_pending.end(); ++it)
+	{
+		map<INT64, SPendingSize>::iterator size = m_sizes.find(it->first);
+		if ( size == m_sizes.end() ) continue;
+		if ( size->second.baserecnum != m_entries[it->second].recnum.RecNum() ) continue;	// a leftover from some other file
+
+		m_entries[it->second].length = size->second.length;
+		m_entries[it->second].resident = size->second.resident;
+	}
+	m_pending.clear();
+	m_sizes.clear();
+
+	// the few whose attribute list is somewhere else
+	for(unsigned int i = 0; i < openlater.size(); i++)
+	{
+		addopened(ntfs, openlater[i]);
+	}
+
+	std::sort(m_entries.begin(), m_entries.end(), entryorder);
+	buildhash();
+
+	m_built = true;
+	return true;
+}
+
+void CNTFSStreamIndex::addrecord(SMFTRecord *rec, INT64 recnum, int recsize, vector<INT64> &openlater)
+{
+	bool isbase = rec->isbaserecord();
+	INT64 baserecnum = isbase ? recnum : rec->baserecnum.RecNum();
+
+	// without an attribute list, the attributes are numbered in the order they're in the base record.
+	// A record with a bad attribute is left out altogether.
+	SMFTAttribute *ala = NULL;
+	CMFTAttributeIterator all(rec, recsize);
+	for(; all.get(); all.next())
+	{
+		if ( all.get()->attributetype == atATTRIBUTELIST ) ala = all.get();
+	}
+	if ( !all.complete() ) return;
+
+	if ( isbase && ala )
+	{
+		if ( ala->isnonresident() )
+		{
+			openlater.push_back(recnum);
+			return;
+		}
+		if ( ala->r.streamoffset + ala->r.streamlength > ala->attributelength ) return;
+		addattributelist( MFT_RECNUM(rec->sequencenumber, recnum), !rec->isinuse(), ala->residentstream(), ala->r.streamlength );
+	}
+
+	for(CMFTAttributeIterator it(rec, recsize); it.get(); it.next())
+	{
+		SMFTAttribute *fa = it.get();
+		int attribnum = it.index();
+		if ( fa->attributetype != atDATA || fa->namelength == 0 ) continue;
+		if ( fa->nameoffset + fa->namelength * sizeof(UINT16) > fa->attributelength ) continue;
+
+		if ( isbase && !ala )
+		{
+			SStreamIndexEntry e;
+			e.recnum = MFT_RECNUM(rec->sequencenumber, recnum);
+			e.attribnum = attribnum;
+			e.name = fa->getname();
+			e.length = fa->streamlength_logical();
+			e.resident = fa->isresident();
+			e.deleted = !rec->isinuse();
+			m_entries.push_back(e);
+		} else if ( fa->isresident() || fa->nr.startingvcn == 0 )
+		{
+			// the part of a listed attribute that has its length, whichever record it's in
+			SPendingSize size;
+			size.baserecnum = baserecnum;
+			size.length = fa->streamlength_logical();
+			size.resident = fa->isresident();
+			m_sizes[pendingkey(recnum, fa->identifier)] = size;
+		}
+	}
+}
+
+void CNTFSStreamIndex::addattributelist(MFT_RECNUM recnum, bool deleted, const char *ala, int alalength)
+{
+	// Consecutive entries for the same attribute are its fragments, and they all count as one
+	// attribute (see CMFTRecord::AttribInfo::read()).
+	int attribnum = -1;
+	const ALArec *prev = NULL;
+	for(int pos = 0; pos + (int)sizeof(ALArec) <= alalength; )
+	{
+		const ALArec *a = (const ALArec *)(ala + pos);
+		if ( !a->isvalid() || pos + a->recordlength > alalength ) break;
+		if ( a->nameoffset + a->namelength * sizeof(UINT16) > a->recordlength ) break;
+
+		if ( !prev || !a->compare(*prev) )
+		{
+			attribnum++;
+			if ( a->attributetype == atDATA && a->namelength > 0 )
+			{
+				SStreamIndexEntry e;
+				e.recnum = recnum;
+				e.attribnum = attribnum;
+				e.name = a->getname();
+				e.length = -1;
+				e.resident = false;
+				e.deleted = deleted;
+				m_entries.push_back(e);
+				m_pending[pendingkey(a->attributelocation.RecNum(), a->identifier)] = m_entries.size() - 1;
+			}
+		}
+		prev = a;
+		pos += a->recordlength;
+	}
+}
+
+void CNTFSStreamIndex::addopened(CNTFS *ntfs, INT64 recnum)
+{
+	CMFTRecord rec;
+	if ( !rec.open(ntfs, &ntfs->getmft(), MFT_RECNUM(0, recnum)) ) return;
+
+	for(int i = 0, count = rec.attributecount(); i < count; i++)
+	{
+		if ( rec.getattributetype(i) != atDATA ) continue;
+
+		SMFTAttribute *fa = rec.getattribute(i, 0);
+		if ( !fa || fa->namelength == 0 ) continue;
+
+		SStreamIndexEntry e;
+		e.recnum = MFT_RECNUM(rec.seqnum(), recnum);
+		e.attribnum = i;
+		e.name = fa->getname();
+		e.length = fa->streamlength_logical();
+		e.resident = fa->isresident();
+		e.deleted = rec.isdeleted();
+		m_entries.push_back(e);
+	}
+}
+
+UINT32 CNTFSStreamIndex::hashname(const wstring &name)
+{
+	// FNV-1a, folded to upper case since stream names don't care
+	UINT32 h = 2166136261U;
+	for(unsigned int i = 0; i < name.length(); i++)
+	{
+		h ^= (UINT32)towupper(name[i]);
+		h *= 16777619U;
+	}
+	return h;
+}
+
+void CNTFSStreamIndex::buildhash()
+{
+	unsigned int size = 16;
+	while ( size < m_entries.size() * 2 ) size <<= 1;
+
+	m_buckets.assign(size, -1);
+	m_next.assign(m_entries.size(), -1);
+	for(int i = m_entries.size() - 1; i >= 0; i--)		// backwards, so each chain is in entry order
+	{
+		UINT32 b = hashname(m_entries[i].name) & (size - 1);
+		m_next[i] = m_buckets[b];
+		m_buckets[b] = i;
+	}
+}
+
+int CNTFSStreamIndex::find(const wstring &name, vector<int> &entries) const
+{
+	if ( !isvalid() || m_buckets.empty() ) return 0;
+
+	int found = 0;
+	for(int i = m_buckets[hashname(name) & (m_buckets.size() - 1)]; i >= 0; i = m_next[i])
+	{
+		if ( AD_WCSICMP(m_entries[i].name.c_str(), name.c_str()) == 0 )
+		{
+			entries.push_back(i);
+			found++;
+		}
+	}
+	return found;
+}
+
+}		// end namespace NTFS
+}		// end namespace AccessData
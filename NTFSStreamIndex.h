@@ -0,0 +1,123 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef NTFSSTREAMINDEX_H
+#define NTFSSTREAMINDEX_H
+
+#include "ADIOTypes.h"
+#include "MFT_RECNUM.h"
+#include "StringTypes.h"
+#include <vector>
+#include <map>
+
+namespace AccessData
+{
+namespace NTFS
+{
+
+using std::vector;
+using std::map;
+
+// fwd defines
+class CNTFS;
+struct SMFTRecord;
+
+// SStreamIndexEntry
+// A named $DATA stream (alternate data stream)
+struct SStreamIndexEntry
+{
+	MFT_RECNUM	recnum;				// the base record
+	UINT16		attribnum;			// the attribute index, as CMFTRecord and the UFIDs number them
+	wstring		name;
+	INT64		length;				// -1 if the part of the attribute with the length wasn't found
+	bool		resident;
+	bool		deleted;			// the record isn't in use
+};
+
+// CNTFSStreamIndex
+// Every named $DATA stream on the volume, found with one pass over the MFT.  Attribute lists that
+// are resident are read straight out of the base record, and the subrecords they point to are
+// picked up as the pass goes by them.  Only files whose attribute list is non-resident are opened.
+// Names are looked up through a hash table, without regard to case.
+class CNTFSStreamIndex
+{
+public:
+	CNTFSStreamIndex();
+	~CNTFSStreamIndex();
+
+	bool			isvalid() const			{ return m_built; }
+	void			clear();
+
+	bool			build(CNTFS *ntfs);
+
+	int							count() const		{ return m_entries.size(); }
+	const SStreamIndexEntry&	entry(int i) const	{ return m_entries[i]; }
+
+	// find()
+	// Adds the index of every stream called name to entries.  Returns how many were added.
+	int				find(const wstring &name, vector<int> &entries) const;
+protected:
+	friend class CStreamIndexSink;
+
+	// SPendingSize
+	// What the attribute itself said about a stream named in an attribute list
+	struct SPendingSize
+	{
+		INT64	baserecnum;			// the base record of the record the attribute was in
+		INT64	length;
+		bool	resident;
+	};
+	// Attribute identifiers are only unique inside one record, so the key is the record
+	// that holds the attribute's first fragment, not the base record.
+	static INT64	pendingkey(INT64 recnum, UINT16 identifier)	{ return (recnum << 16) | identifier; }
+	static UINT32	hashname(const wstring &name);
+
+	void			addrecord(SMFTRecord *rec, INT64 recnum, int recsize, vector<INT64> &openlater);
+	void			addattributelist(MFT_RECNUM recnum, bool deleted, const char *ala, int alalength);
+	void			addopened(CNTFS *ntfs, INT64 recnum);
+	void			buildhash();
+
+	vector<SStreamIndexEntry>	m_entries;
+	map<INT64, int>				m_pending;		// pendingkey() -> m_entries index, while building
+	map<INT64, SPendingSize>	m_sizes;		// pendingkey() -> what a subrecord said, while building
+	vector<int>					m_buckets;		// hashname() & (size-1) -> first m_entries index, -1 if none
+	vector<int>					m_next;			// per entry, the next in the same bucket
+	bool						m_built;
+private:
+	CNTFSStreamIndex(const CNTFSStreamIndex &rhs);				// disallow
+	CNTFSStreamIndex &operator=(const CNTFSStreamIndex &rhs);	// disallow
+};
+
+}		// end namespace NTFS
+}		// end namespace AccessData
+
+#endif
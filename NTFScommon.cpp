@@ -30,6 +30,8 @@
 
 #include "NTFScommon.h"
 
+#include <string.h>
+
 namespace AccessData
 {
 namespace NTFS
@@ -40,49 +42,118 @@ bool dofixup(void *rec, int recsize, int blocksize, int fixupcount, UINT16 *fixu
 	UINT16 magiccookie = *fixups;
 	fixups++;
 
-	int bc = recsize / blocksize;
-	if ( fixupcount-1 != bc ) return false;
+	// one fixup per block, plus the cookie
+	int bc = fixupcount-1;
+	if ( bc * blocksize != recsize ) return false;
 
+	// check every block before touching any of them, so a bad record is left as it was read
+	UINT16 bad = 0;
+	char *blockend = ((char *)rec) + blocksize - 2;
 	for(int i=0; i < bc; i++)
 	{
-		UINT16 *p = (UINT16 *)( ((char *)rec) + (blocksize*(i+1)) - 2 );
+		bad |= *(UINT16 *)(blockend + i * blocksize) ^ magiccookie;
+	}
+	if ( bad != 0 ) return false;
 
-		if ( *p != magiccookie ) return false;
-		*p = fixups[i];
+	for(int i=0; i < bc; i++)
+	{
+		*(UINT16 *)(blockend + i * blocksize) = fixups[i];
 	}
 	return true;
 }
 
-#pragma pack(push,1)
-struct SNTFSUFID
+int dofixupbatch(void *recs, int reccount, int recsize, int blocksize, UINT32 *validmask)
 {
-	UINT8 flags;
-	UINT8 reserved;
-	UINT16 attribnum;
-	UINT32 recnum;
-	enum { ISSLACK = 1 };
-};
-#pragma pack(pop)
-
-UFID_t ntfs2ufid(UINT16 attribnum, UINT64 recnum, bool isslack)
+	if ( !recs || !validmask || reccount <= 0 || blocksize <= 0 || recsize < blocksize ) return 0;
+
+	int bc = recsize / blocksize;
+	int good = 0;
+	memset(validmask, 0, ((reccount + 31) / 32) * sizeof(UINT32));
+
+	char *rec = (char *)recs;
+	for(int r = 0; r < reccount; r++, rec += recsize)
+	{
+		// every record with fixups keeps the list offset and count in the same place
+		UINT16 fixupoffset = *(UINT16 *)(rec + 4);
+		UINT16 fixupcount = *(UINT16 *)(rec + 6);
+		if ( fixupcount-1 != bc || fixupoffset + fixupcount * 2 > recsize ) continue;
+
+		UINT16 *fixups = (UINT16 *)(rec + fixupoffset);
+		UINT16 magiccookie = fixups[0];
+		char *blockend = rec + blocksize - 2;
+
+		// no branches until every block has been looked at
+		UINT16 bad = 0;
+		for(int i = 0; i < bc; i++)
+		{
+			bad |= *(UINT16 *)(blockend + i * blocksize) ^ magiccookie;
+		}
+		if ( bad != 0 ) continue;
+
+		for(int i = 0; i < bc; i++)
+		{
+			*(UINT16 *)(blockend + i * blocksize) = fixups[i + 1];
+		}
+		validmask[r / 32] |= 1u << (r % 32);
+		good++;
+	}
+	return good;
+}
+
+// UFID layout: bits 0-30 are the record number, 31-46 the sequence number, 47 is set for slack,
+// 48-61 are the attribute index, 62 is the layout bit and 63 is always clear.
+#define UFID_SPECIALRECNUMS	16
+#define UFID_SEQSHIFT		31
+#define UFID_SLACKBIT		(((UINT64)1) << 47)
+#define UFID_ATTRIBSHIFT	48
+#define UFID_ATTRIBMASK		0x3FFF
+#define UFID_LAYOUTBIT		(((UINT64)1) << 62)
+#define UFID_SIGNBIT		(((UINT64)1) << 63)
+
+UFID_t ntfs2ufid(UINT16 attribnum, UINT64 recnum, UINT16 seqnum, bool isslack)
+{
+	if ( attribnum > UFID_ATTRIBMASK ) return -1;
+
+	// the special record numbers are small negative numbers, the rest have to stay below them
+	bool isspecial = (INT64)recnum < 0 && (INT64)recnum >= -UFID_SPECIALRECNUMS;
+	if ( !isspecial && recnum >= UFID_RECNUM(-UFID_SPECIALRECNUMS) ) return -1;
+
+	UINT64 ufid = UFID_RECNUM(recnum) | UFID_LAYOUTBIT;
+	ufid |= ((UINT64)seqnum) << UFID_SEQSHIFT;
+	ufid |= ((UINT64)attribnum) << UFID_ATTRIBSHIFT;
+	if ( isslack ) ufid |= UFID_SLACKBIT;
+
+	return (UFID_t)ufid;
+}
+
+bool ufid2ntfs(UFID_t ufid, UINT16 &attribnum, UINT64 &recnum, UINT16 &seqnum, bool &isslack)
 {
-	UFID_t ufid = 0;
-	SNTFSUFID &ntfsufid = *((SNTFSUFID *)(&ufid));
+	recnum = UFID_RECNUM(ufid);
+	seqnum = (UINT16)( ((UINT64)ufid) >> UFID_SEQSHIFT );
+	attribnum = (UINT16)(( ((UINT64)ufid) >> UFID_ATTRIBSHIFT ) & UFID_ATTRIBMASK);
+	isslack = ( ((UINT64)ufid) & UFID_SLACKBIT ) != 0;
 
-	ntfsufid.attribnum = attribnum;
-	ntfsufid.recnum = (UINT32)(recnum & 0xFFFFFFFFL);
-	ntfsufid.flags |= isslack ? SNTFSUFID::ISSLACK : 0;
+	return !ufidislegacy(ufid);
+}
 
-	return ufid;
+bool ufidislegacy(UFID_t ufid)
+{
+	return ( ((UINT64)ufid) & (UFID_LAYOUTBIT | UFID_SIGNBIT) ) != UFID_LAYOUTBIT;
 }
 
-void ufid2ntfs(UFID_t ufid, UINT16 &attribnum, UINT64 &recnum, bool &isslack)
+UFID_t ufidfromlegacy(UFID_t ufid)
 {
-	SNTFSUFID &ntfsufid = *((SNTFSUFID *)(&ufid));
+	if ( ufid == -1 || !ufidislegacy(ufid) ) return -1;
+
+	// the old layout, low byte first: flags (1 = slack), reserved, 16 bit attribute index, 32 bit record number
+	UINT64 old = (UINT64)ufid;
+	UINT32 recnum = (UINT32)(old >> 32);
+	UINT16 attribnum = (UINT16)(old >> 16);
+	bool isslack = (old & 1) != 0;
 
-	recnum = ntfsufid.recnum;
-	attribnum = ntfsufid.attribnum;
-	isslack = (ntfsufid.flags & SNTFSUFID::ISSLACK) == SNTFSUFID::ISSLACK;
+	// the special record numbers (UNALLOCRECNUM and friends) were small negative numbers cut down to 32 bits
+	INT64 fullrecnum = (INT32)recnum < 0 && (INT32)recnum >= -UFID_SPECIALRECNUMS ? (INT64)(INT32)recnum : (INT64)recnum;
+	return ntfs2ufid(attribnum, fullrecnum, 0, isslack);
 }
 
 #define NTFS_TIME_FUDGE (0x019db1ded53e8000L)	// subtract this number from an NTFS 64bit time value to justify it to Jan 1, 1970
@@ -80,8 +80,30 @@ enum ENTFSSystemFileRecordNumbers
 };
 
 bool	dofixup(void *rec, int recsize, int blocksize, int fixupcount, UINT16 *fixups);
-UFID_t	ntfs2ufid(UINT16 attribnum, UINT64 recnum, bool isslack);
-void	ufid2ntfs(UFID_t ufid, UINT16 &attribnum, UINT64 &recnum, bool &isslack);
+
+// dofixupbatch()
+// Fixes up reccount records of recsize bytes that sit one after another in recs (MFT records or
+// index nodes, anything with the fixup list offset and count at 4 and 6).  Bit i of validmask
+// (which needs room for reccount bits) is set if record i checked out and was fixed up, records
+// that don't are left untouched.  Returns the number of good records.
+int		dofixupbatch(void *recs, int reccount, int recsize, int blocksize, UINT32 *validmask);
+// ntfs2ufid() / ufid2ntfs()
+// A UFID holds a 31 bit record number, the base record's 16 bit sequence number, the slack flag, a 14 bit
+// attribute index and a layout bit that is always set.  The top bit is never set, so a UFID is never
+// negative and never -1.  That limits UFIDs to records below 2^31 - 16 (a 2T $MFT with 1K records),
+// the 16 record numbers above that are for the special files (CNTFS::UNALLOCRECNUM and friends).
+// A sequence number of 0 matches any record, like in an MFT_RECNUM; anything else has to match the
+// record's when the UFID is opened, so a UFID for a file that's gone doesn't open whatever reused it.
+// ntfs2ufid() returns -1 if recnum or attribnum doesn't fit.  ufid2ntfs() returns false for a UFID
+// without the layout bit, which is what UFIDs saved before it was added (32 bit record number, 16 bit
+// attribute index and a flags byte) look like, instead of reading them as some other file.  Convert
+// those with ufidfromlegacy(), which can't know the sequence number and leaves it 0.  The one exception
+// is an old UFID for a record number from 2^30 to 2^31, which would take an MFT of over a billion records.
+#define UFID_RECNUM(recnum)		(((UINT64)(recnum)) & 0x000000007FFFFFFFL)
+UFID_t	ntfs2ufid(UINT16 attribnum, UINT64 recnum, UINT16 seqnum, bool isslack);
+bool	ufid2ntfs(UFID_t ufid, UINT16 &attribnum, UINT64 &recnum, UINT16 &seqnum, bool &isslack);
+bool	ufidislegacy(UFID_t ufid);
+UFID_t	ufidfromlegacy(UFID_t ufid);		// -1 if ufid isn't an old style UFID, or won't fit in the new layout
 time_t	ntfstime2time_t(UINT64 ntfstime);
 
 }		// end namespace NTFS
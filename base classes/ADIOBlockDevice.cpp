@@ -30,4 +30,29 @@
 
 #include "ADIOBlockDevice.h"
 
-/* nada */
+namespace AccessData
+{
+
+int CFTKBlockDevice::ftkbioBlockReadV(const SIOVec *iov, int iovcount, fssize_t startblocknum)
+{
+	if ( !iov || iovcount < 0 ) return -1;
+
+	int blocksize = ftkbioBlockSize();
+	if ( blocksize <= 0 ) return -1;
+
+	int blocksread = 0;
+	for(int i = 0; i < iovcount; i++)
+	{
+		int count = iov[i].length / blocksize;
+		if ( count <= 0 ) continue;
+
+		int r = ftkbioBlockReadN(iov[i].base, startblocknum + blocksread, count);
+		if ( r < 0 ) return blocksread ? blocksread : -1;
+
+		blocksread += r;
+		if ( r < count ) break;
+	}
+	return blocksread;
+}
+
+}		// end namespace
@@ -34,6 +34,7 @@
 #include "IntTypes.h"
 #include "JobCallBack.h"
 #include "ADIOBaseMD.h"
+#include "ADStream.h"
 
 namespace AccessData
 {
@@ -58,6 +59,13 @@ public:
 	// Returns -1 on error or number of blocks read on success.
 	virtual int				ftkbioBlockReadN(void *dest, fssize_t startblocknum, int count) = 0;
 
+	// ftkbioBlockReadV()
+	// Reads sequential blocks starting at startblocknum into the buffers in iov, one after another.
+	// Each buffer's length should be a whole number of blocks, anything past that is left alone.
+	// Returns -1 on error or number of blocks read on success.
+	// Unlike the rest of this interface there is a default, which calls ftkbioBlockReadN() once per buffer.
+	virtual int				ftkbioBlockReadV(const SIOVec *iov, int iovcount, fssize_t startblocknum);
+
 	// ftkbioBlockSizeGet()
 	// Returns the size of blocks on this device.
 	virtual int				ftkbioBlockSize() const = 0;
@@ -31,6 +31,7 @@
 #include "ADIOFSBase.h"
 
 #include "ADIOFile.h"
+#include "IOTrace.h"
 #include "Logger.h"
 
 namespace AccessData
@@ -46,6 +47,7 @@ void CFSBase::initfields()
 	m_clustercount = 0;
 	m_clustersize = 0;
 	m_clusterscale = 0;
+	m_trace = NULL;
 }
 
 void CFSBase::clearfields()
@@ -189,9 +191,25 @@ fssize_t CFSBase::UsedBlockCount()
 	return isvalid() ? 0 : -1;
 }
 
+void CFSBase::settrace(CIOTraceRecorder *trace)
+{
+	m_trace = trace;
+	if ( m_trace && isvalid() ) m_trace->start(m_clustersize);
+}
+
 bool CFSBase::ftkbioBlockRead(void *dest, fssize_t blocknum, int startoffset, int bytestoread)
 {
 	if ( bytestoread < 0 ) bytestoread = m_clustersize;
+	if ( !m_trace ) return readcluster(dest, blocknum, startoffset, bytestoread);
+
+	INT64 timestamp = IOTimestamp();
+	bool result = readcluster(dest, blocknum, startoffset, bytestoread);
+	m_trace->record(timestamp, blocknum, startoffset, bytestoread, 1, result ? 0 : STraceRecord::FLAG_FAILED);
+	return result;
+}
+
+bool CFSBase::readcluster(void *dest, fssize_t blocknum, int startoffset, int bytestoread)
+{
 	if ( !isvalid() || !dest || (blocknum < m_firstcluster) || blocknum >= m_clustercount || (startoffset+bytestoread > m_clustersize) ) return false;
 
 	if ( m_clusterscale == 1 ) return m_dev->ftkbioBlockRead(dest, m_cluster0block+blocknum, startoffset, bytestoread);
@@ -217,9 +235,36 @@ int CFSBase::ftkbioBlockReadN(void *dest, fssize_t startblocknum, int count)
 {
 	if ( !isvalid() || !dest || startblocknum < m_firstcluster ) return 0;
 
+	INT64 timestamp = m_trace ? IOTimestamp() : 0;
 	fssize_t x = translateclusternum(startblocknum); // m_cluster0block+(startblocknum*m_clusterscale);
 	int y = count * m_clusterscale;
-	return m_dev->ftkbioBlockReadN(dest, x, y) / m_clusterscale;
+	int result = m_dev->ftkbioBlockReadN(dest, x, y) / m_clusterscale;
+
+	if ( m_trace )
+	{
+		int flags = STraceRecord::FLAG_READN | (result != count ? STraceRecord::FLAG_FAILED : 0);
+		m_trace->record(timestamp, startblocknum, 0, count * m_clustersize, count, flags);
+	}
+	return result;
+}
+
+int CFSBase::ftkbioBlockReadV(const SIOVec *iov, int iovcount, fssize_t startblocknum)
+{
+	if ( !isvalid() || !iov || startblocknum < m_firstcluster ) return 0;
+
+	// a cluster buffer is a whole number of device blocks, so the buffers go down as they are
+	INT64 timestamp = m_trace ? IOTimestamp() : 0;
+	int result = m_dev->ftkbioBlockReadV(iov, iovcount, translateclusternum(startblocknum)) / m_clusterscale;
+
+	if ( m_trace )
+	{
+		int length = 0;
+		for(int i = 0; i < iovcount; i++) length += iov[i].length;
+		int count = length / m_clustersize;
+		int flags = STraceRecord::FLAG_READN | (result != count ? STraceRecord::FLAG_FAILED : 0);
+		m_trace->record(timestamp, startblocknum, 0, length, count, flags);
+	}
+	return result;
 }
 
 int CFSBase::ftkbioBlockSize() const
@@ -299,6 +344,7 @@ bool CFSBase::setclustertranslation(int scale, fssize_t cluster0block, fssize_t
 	m_cluster0block = cluster0block;
 	m_clustercount = clustercount;
 	m_clustersize = m_blocksize * m_clusterscale;
+	if ( m_trace ) m_trace->start(m_clustersize);
 	return true;
 }
 
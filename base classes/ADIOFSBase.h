@@ -36,6 +36,8 @@
 namespace AccessData
 {
 
+class CIOTraceRecorder;
+
 // CFTKFSBase
 class CFSBase : public CFileSystem
 {
@@ -47,6 +49,14 @@ public:
 	void			clear();
 	//void			assign(const CFSBase &rhs);
 
+	// settrace()
+	// Records every cluster read made through this filesystem into trace, before it
+	// reaches any cache or device below us.  trace is (re)started with the cluster size
+	// when the filesystem is mounted, or right away if it already is.  Doesn't take
+	// ownership; NULL stops recording.  Set it before reading, not while other threads are.
+	void			settrace(CIOTraceRecorder *trace);
+	bool			istracing() const		{ return m_trace != NULL; }
+
 	//
 	// CFTKFileSystem methods
 	//
@@ -74,6 +84,7 @@ public:
 	//
 	bool			ftkbioBlockRead(void *dest, fssize_t blocknum, int startoffset=0, int bytestoread=-1);
 	int				ftkbioBlockReadN(void *dest, fssize_t startblocknum, int count);
+	int				ftkbioBlockReadV(const SIOVec *iov, int iovcount, fssize_t startblocknum);
 	int				ftkbioBlockSize() const;
 	int				ftkbioPhysicalBlockSize() const;
 	fssize_t		ftkbioFirstBlockNum() const;
@@ -98,12 +109,15 @@ protected:
 	fssize_t			m_clustercount;		// the number of clusters
 	int					m_clustersize;		// the size of a cluster (in bytes)
 	int					m_clusterscale;		// how many m_dev blocks per cluster
+	CIOTraceRecorder*	m_trace;			// survives clear(), only set by settrace()
 
 	bool				setblockdevice(CFTKBlockDevice *dev);
 	bool				setclustertranslation(int scale, fssize_t cluster0block, fssize_t clustercount, fssize_t m_firstcluster);
 	fssize_t			translateclusternum(fssize_t clusternum) const { return m_cluster0block + (clusternum*m_clusterscale); }
 
 private:
+	bool				readcluster(void *dest, fssize_t blocknum, int startoffset, int bytestoread);
+
 	void initfields();
 	void clearfields();
 	void assignfields(const CFSBase &rhs);
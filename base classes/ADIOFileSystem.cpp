@@ -31,5 +31,50 @@
 
 #include "ADIOFileSystem.h"
 
+namespace AccessData
+{
 
-/* nada */
+CQueryUFIDBatch::CQueryUFIDBatch(CQueryUFIDSink &sink, int batchsize) : m_sink(sink)
+{
+	m_batchsize = batchsize > 0 ? batchsize : 1;
+	m_stopped = false;
+	m_results.reserve(m_batchsize);
+}
+
+bool CQueryUFIDBatch::add(UFID_t ufid, UINT32 flags)
+{
+	if ( m_stopped ) return false;
+	if ( ufid == -1 ) return true;		// a file the filesystem couldn't make a UFID for
+
+	SQueryUFID r;
+	r.ufid = ufid;
+	r.flags = flags;
+	m_results.push_back(r);
+
+	return (int)m_results.size() < m_batchsize || flush();
+}
+
+bool CQueryUFIDBatch::flush()
+{
+	if ( m_stopped ) return false;
+	if ( m_results.empty() ) return true;
+
+	if ( !m_sink.ufids(&m_results[0], m_results.size()) ) m_stopped = true;
+	m_results.clear();
+	return !m_stopped;
+}
+
+bool CFileSystem::QueryUFIDs(CQueryUFIDSink &sink, int queryoptions)
+{
+	vector<UFID_t> ufids;
+	if ( !QueryUFIDs(ufids, queryoptions) ) return false;
+
+	CQueryUFIDBatch batch(sink);
+	for(unsigned int i = 0; i < ufids.size(); i++)
+	{
+		if ( !batch.add(ufids[i], 0) ) return false;
+	}
+	return batch.flush();
+}
+
+};		// end namespace
@@ -45,6 +45,44 @@ using std::vector;
 class CFile;
 class CDirectory;
 
+// SQueryUFID
+// One result from CFileSystem::QueryUFIDs()
+struct SQueryUFID
+{
+	UFID_t		ufid;
+	UINT32		flags;			// CFileSystem::EQueryUFIDFlags
+};
+
+// CQueryUFIDSink
+// Takes the results of CFileSystem::QueryUFIDs() a batch at a time, as they're found.
+// Return false from ufids() to stop the query, say if the job was cancelled.
+class CQueryUFIDSink
+{
+public:
+	virtual ~CQueryUFIDSink() { }
+	virtual bool	ufids(const SQueryUFID *results, int count) = 0;
+};
+
+// CQueryUFIDBatch
+// Collects results for a CQueryUFIDSink and hands them over batchsize at a time.
+// add() and flush() return false once the sink has asked to stop.  add() skips a ufid of -1.
+class CQueryUFIDBatch
+{
+public:
+	CQueryUFIDBatch(CQueryUFIDSink &sink, int batchsize = 1024);
+
+	bool			add(UFID_t ufid, UINT32 flags);
+	bool			flush();
+protected:
+	CQueryUFIDSink&		m_sink;
+	vector<SQueryUFID>	m_results;
+	int					m_batchsize;
+	bool				m_stopped;
+private:
+	CQueryUFIDBatch(const CQueryUFIDBatch &rhs);				// disallow
+	CQueryUFIDBatch &operator=(const CQueryUFIDBatch &rhs);		// disallow
+};
+
 
 // CFTKFileSystem
 // This class defines the base interface of a file system.
@@ -65,6 +103,14 @@ public:
         INCLUDEDELETED	= 0x0010,			// include deleted files
         INCLUDEALL		= 0xFFFF,			// include all files
 	};
+	enum EQueryUFIDFlags
+	{
+		QUFIDFILE		= 0x0001,			// a file's data
+		QUFIDSLACK		= 0x0002,			// the slack at the end of a file
+		QUFIDDIRECTORY	= 0x0004,			// a directory
+		QUFIDSPECIAL	= 0x0008,			// fsslack, unalloc and the like
+		QUFIDDELETED	= 0x0010,			// the file has been deleted
+	};
 	//
 	// CFTKFileSystem pure virtual methods
 	//
@@ -101,6 +147,12 @@ public:
     // Replacement for ftkfsEnumerationGet()
     virtual bool				QueryUFIDs(vector<UFID_t> &ufids, int queryoptions) = 0;
 
+    // QueryUFIDs()
+    // Hands the ufids to sink in batches as they're found, instead of collecting them all first.
+    // Returns false if the sink stopped the query or there was an error.
+    // The default just runs the vector version and passes its results on, with no flags.
+    virtual bool				QueryUFIDs(CQueryUFIDSink &sink, int queryoptions);
+
     // GetParentUFID()
     // Returns the parent ufid of the passed-in ufid.
     // Returns -1 if there is no parent or an error
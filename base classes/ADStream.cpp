@@ -39,5 +39,24 @@ CStream::~CStream()
 {
 }
 
+int CStream::ReadV(const SIOVec *iov, int count, INT64 pos)
+{
+	if ( !iov || count < 0 ) return -1;
+
+	int totalbytesread = 0;
+	for(int i = 0; i < count; i++)
+	{
+		if ( iov[i].length <= 0 ) continue;
+
+		int bytesread = Read(iov[i].base, iov[i].length, pos);
+		if ( bytesread < 0 ) return totalbytesread ? totalbytesread : -1;
+
+		totalbytesread += bytesread;
+		pos += bytesread;
+		if ( bytesread < iov[i].length ) break;
+	}
+	return totalbytesread;
+}
+
 
 }		// end namespace
@@ -36,6 +36,14 @@
 namespace AccessData
 {
 
+// SIOVec
+// One buffer of a scatter read, see CStream::ReadV()
+struct SIOVec
+{
+	void*	base;
+	int		length;
+};
+
 // CStream
 // This is the base interface for a random access file/stream.
 class CStream
@@ -60,6 +68,12 @@ public:
 	virtual int				Read(void *dest, int bytestoread) = 0;
 	virtual int				Read(void *dest, int bytestoread, INT64 pos) = 0;
 
+	// ReadV()
+	// Reads from pos into count buffers, filling each one before moving on to the next, as if they
+	// were one buffer.  Returns the number of bytes read, -1 on error.
+	// The default just calls Read() for each buffer.
+	virtual int				ReadV(const SIOVec *iov, int count, INT64 pos);
+
 	// eof
 	// Returns true if the current file position is at or past the end of the file
 	virtual bool			Eof() = 0;
@@ -0,0 +1,790 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "BlockCache.h"
+
+#include <windows.h>
+#include <malloc.h>
+#include <string.h>
+#include <list>
+#include <map>
+
+namespace AccessData
+{
+
+using std::list;
+using std::map;
+
+void SBlockCacheStats::clear()
+{
+	memset(this, 0, sizeof(*this));
+}
+
+double SBlockCacheStats::hitratio(int tag) const
+{
+	INT64 h = 0, m = 0;
+	for(int i = 0; i < iotagCOUNT; i++)
+	{
+		if ( tag != -1 && tag != i ) continue;
+		h += hits[i];
+		m += misses[i];
+	}
+	return h + m > 0 ? (double)h / (double)(h + m) : 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+// SReadVPiece, SReadVPage
+// ftkbioBlockReadV() cuts its buffers at page boundaries.  A piece is the part of one
+// buffer that falls in one page, and a page lists the pieces that fall in it.
+struct SReadVPiece
+{
+	int			offset;				// bytes into the page
+	int			length;
+	char*		dest;
+	bool		done;
+};
+
+struct SReadVPage
+{
+	fssize_t	pagenum;
+	int			firstpiece;
+	int			piececount;
+	bool		missing;			// some piece wasn't in the cache
+	bool		direct;				// a missing page that is read straight into its only piece
+};
+
+//-----------------------------------------------------------------------------
+
+// CBlockCache::CShard
+// One ARC instance and its lock.  T1 holds pages seen once recently, T2 pages seen
+// at least twice; B1 and B2 remember (without data) what was recently evicted from
+// each, and a hit on one of those ghosts moves the T1/T2 split (m_target) towards
+// the list that would have kept the page.  Pinned pages are outside of ARC.
+// All methods expect the caller to hold the lock.
+class CBlockCache::CShard
+{
+public:
+	enum { T1, T2, B1, B2, PINNED, LISTCOUNT };
+
+	CShard(int capacity, int pagesize);
+	~CShard();
+
+	void			lock()		{ EnterCriticalSection(&m_lock); }
+	void			unlock()	{ LeaveCriticalSection(&m_lock); }
+
+	void			clear();
+	void			setcapacity(int capacity, int pinnedcapacity);
+	bool			contains(fssize_t pagenum) const;
+	const char*		lookup(fssize_t pagenum, bool promote);
+	void			insert(fssize_t pagenum, const char *data, bool pin);
+	void			insertring(fssize_t pagenum, const char *data);
+
+	INT64			m_hits[iotagCOUNT];
+	INT64			m_misses[iotagCOUNT];
+	INT64			m_evictions;
+	int				m_sizes[LISTCOUNT];
+private:
+	struct SEntry
+	{
+		int							listnum;
+		list<fssize_t>::iterator	pos;
+		char*						data;		// NULL in the ghost lists
+	};
+	typedef map<fssize_t, SEntry> ENTRYMAP;
+
+	enum { RINGPAGES = 4 };
+	struct SRingPage
+	{
+		fssize_t	pagenum;
+		char*		data;
+	};
+
+	void			move(ENTRYMAP::iterator e, int listnum);	// to the MRU end of listnum
+	void			drop(int listnum);							// forget the LRU page of listnum
+	void			replace(bool inb2);							// demote a resident page to its ghost list
+
+	CRITICAL_SECTION	m_lock;
+	ENTRYMAP			m_entries;
+	list<fssize_t>		m_lists[LISTCOUNT];		// MRU at the front
+	int					m_capacity;				// resident pages, not counting pinned ones
+	int					m_pinnedcapacity;
+	int					m_target;				// ARC's p: the size T1 is aiming for
+	int					m_pagesize;
+	SRingPage			m_ring[RINGPAGES];		// the pages bulk reads go into, replaced round robin
+	int					m_ringnext;
+
+	CShard(const CShard &rhs);				// disallow
+	CShard &operator=(const CShard &rhs);	// disallow
+};
+
+CBlockCache::CShard::CShard(int capacity, int pagesize)
+{
+	InitializeCriticalSection(&m_lock);
+	m_pagesize = pagesize;
+	m_target = 0;
+	setcapacity(capacity, 0);
+	for(int i = 0; i < RINGPAGES; i++)
+	{
+		m_ring[i].pagenum = -1;
+		m_ring[i].data = NULL;
+	}
+	m_ringnext = 0;
+	m_evictions = 0;
+	memset(m_hits, 0, sizeof(m_hits));
+	memset(m_misses, 0, sizeof(m_misses));
+	memset(m_sizes, 0, sizeof(m_sizes));
+}
+
+CBlockCache::CShard::~CShard()
+{
+	clear();
+	DeleteCriticalSection(&m_lock);
+}
+
+void CBlockCache::CShard::clear()
+{
+	for(ENTRYMAP::iterator i = m_entries.begin(); i != m_entries.end(); ++i)
+	{
+		if ( i->second.data ) free(i->second.data);
+	}
+	m_entries.clear();
+	for(int i = 0; i < RINGPAGES; i++)
+	{
+		if ( m_ring[i].data ) free(m_ring[i].data);
+		m_ring[i].pagenum = -1;
+		m_ring[i].data = NULL;
+	}
+	for(int l = 0; l < LISTCOUNT; l++)
+	{
+		m_lists[l].clear();
+		m_sizes[l] = 0;
+	}
+	m_target = 0;
+}
+
+void CBlockCache::CShard::setcapacity(int capacity, int pinnedcapacity)
+{
+	// pinned pages come out of the same budget, but leave ARC at least one page
+	m_pinnedcapacity = pinnedcapacity < capacity ? pinnedcapacity : capacity - 1;
+	if ( m_pinnedcapacity < 0 ) m_pinnedcapacity = 0;
+	m_capacity = capacity - m_pinnedcapacity > 0 ? capacity - m_pinnedcapacity : 1;
+	if ( m_target > m_capacity ) m_target = m_capacity;
+}
+
+bool CBlockCache::CShard::contains(fssize_t pagenum) const
+{
+	ENTRYMAP::const_iterator e = m_entries.find(pagenum);
+	if ( e != m_entries.end() && e->second.data != NULL ) return true;
+
+	for(int i = 0; i < RINGPAGES; i++)
+	{
+		if ( m_ring[i].pagenum == pagenum ) return true;
+	}
+	return false;
+}
+
+void CBlockCache::CShard::move(ENTRYMAP::iterator e, int listnum)
+{
+	SEntry &entry = e->second;
+	if ( entry.listnum == listnum )
+	{
+		m_lists[listnum].splice(m_lists[listnum].begin(), m_lists[listnum], entry.pos);
+		return;
+	}
+
+	m_lists[entry.listnum].erase(entry.pos);
+	m_sizes[entry.listnum]--;
+	m_lists[listnum].push_front(e->first);
+	m_sizes[listnum]++;
+	entry.listnum = listnum;
+	entry.pos = m_lists[listnum].begin();
+}
+
+void CBlockCache::CShard::drop(int listnum)
+{
+	if ( m_sizes[listnum] == 0 ) return;
+
+	ENTRYMAP::iterator e = m_entries.find( m_lists[listnum].back() );
+	if ( e->second.data ) { free(e->second.data); m_evictions++; }
+	m_entries.erase(e);
+	m_lists[listnum].pop_back();
+	m_sizes[listnum]--;
+}
+
+void CBlockCache::CShard::replace(bool inb2)
+{
+	if ( m_sizes[T1] + m_sizes[T2] < m_capacity ) return;		// still room
+
+	int from = T1;
+	if ( m_sizes[T1] == 0 || (m_sizes[T1] < m_target || (m_sizes[T1] == m_target && !inb2)) ) from = T2;
+	if ( m_sizes[from] == 0 ) from = from == T1 ? T2 : T1;
+
+	ENTRYMAP::iterator e = m_entries.find( m_lists[from].back() );
+	free(e->second.data);
+	e->second.data = NULL;
+	m_evictions++;
+	move(e, from == T1 ? B1 : B2);
+}
+
+const char *CBlockCache::CShard::lookup(fssize_t pagenum, bool promote)
+{
+	ENTRYMAP::iterator e = m_entries.find(pagenum);
+	if ( e != m_entries.end() && e->second.data )
+	{
+		if ( promote && e->second.listnum != PINNED ) move(e, T2);
+		return e->second.data;
+	}
+
+	for(int i = 0; i < RINGPAGES; i++)
+	{
+		if ( m_ring[i].pagenum == pagenum ) return m_ring[i].data;
+	}
+	return NULL;
+}
+
+void CBlockCache::CShard::insertring(fssize_t pagenum, const char *data)
+{
+	if ( contains(pagenum) ) return;
+
+	SRingPage &slot = m_ring[m_ringnext];
+	if ( !slot.data && (slot.data = (char *)malloc(m_pagesize)) == NULL ) return;
+
+	memcpy(slot.data, data, m_pagesize);
+	slot.pagenum = pagenum;
+	m_ringnext = (m_ringnext + 1) % RINGPAGES;
+}
+
+void CBlockCache::CShard::insert(fssize_t pagenum, const char *data, bool pin)
+{
+	ENTRYMAP::iterator e = m_entries.find(pagenum);
+	if ( e != m_entries.end() && e->second.data ) return;		// another thread got here first
+
+	char *copy = (char *)malloc(m_pagesize);
+	if ( !copy ) return;
+	memcpy(copy, data, m_pagesize);
+
+	if ( pin && m_sizes[PINNED] < m_pinnedcapacity )
+	{
+		if ( e == m_entries.end() )
+		{
+			SEntry entry;
+			entry.listnum = PINNED;
+			entry.data = copy;
+			m_lists[PINNED].push_front(pagenum);
+			m_sizes[PINNED]++;
+			entry.pos = m_lists[PINNED].begin();
+			m_entries[pagenum] = entry;
+		} else
+		{
+			e->second.data = copy;
+			move(e, PINNED);
+		}
+		return;
+	}
+
+	if ( e != m_entries.end() )
+	{
+		// a ghost hit, adapt the T1/T2 split towards the list that would have kept it
+		if ( e->second.listnum == B1 )
+		{
+			int delta = m_sizes[B1] > 0 && m_sizes[B2] > m_sizes[B1] ? m_sizes[B2] / m_sizes[B1] : 1;
+			m_target = ad_min(m_target + delta, m_capacity);
+			replace(false);
+		} else
+		{
+			int delta = m_sizes[B2] > 0 && m_sizes[B1] > m_sizes[B2] ? m_sizes[B1] / m_sizes[B2] : 1;
+			m_target = m_target - delta > 0 ? m_target - delta : 0;
+			replace(true);
+		}
+		e->second.data = copy;
+		move(e, T2);
+		return;
+	}
+
+	// a page we've never seen (or forgot), make room following the ARC rules
+	int l1 = m_sizes[T1] + m_sizes[B1];
+	int total = l1 + m_sizes[T2] + m_sizes[B2];
+	if ( l1 >= m_capacity )
+	{
+		if ( m_sizes[T1] < m_capacity )
+		{
+			drop(B1);
+			replace(false);
+		} else
+		{
+			drop(T1);
+		}
+	} else if ( total >= m_capacity )
+	{
+		if ( total >= 2 * m_capacity ) drop(B2);
+		replace(false);
+	}
+
+	SEntry entry;
+	entry.listnum = T1;
+	entry.data = copy;
+	m_lists[T1].push_front(pagenum);
+	m_sizes[T1]++;
+	entry.pos = m_lists[T1].begin();
+	m_entries[pagenum] = entry;
+}
+
+//-----------------------------------------------------------------------------
+
+void CBlockCache::initfields()
+{
+	m_dev = NULL;
+	m_pageblocks = 0;
+	m_pagesize = 0;
+	m_blocksize = 0;
+	m_blockcount = 0;
+	m_maxbytes = 0;
+	m_pinmask = 0;
+	m_maxpinnedbytes = 0;
+}
+
+void CBlockCache::clearfields()
+{
+	m_dev = NULL;
+	for(unsigned int i = 0; i < m_shards.size(); i++) delete m_shards[i];
+	m_shards.clear();
+	m_pageblocks = 0;
+	m_pagesize = 0;
+	m_blocksize = 0;
+	m_blockcount = 0;
+	m_maxbytes = 0;
+}
+
+CBlockCache::CBlockCache()
+{
+	initfields();
+}
+
+CBlockCache::~CBlockCache()
+{
+	clearfields();
+}
+
+bool CBlockCache::isvalid() const
+{
+	return m_dev != NULL && !m_shards.empty();
+}
+
+void CBlockCache::clear()
+{
+	clearfields();
+}
+
+bool CBlockCache::attach(CFTKBlockDevice *dev, int pageblocks, INT64 maxbytes, int shardcount)
+{
+	clear();
+	if ( !dev || !dev->isvalid() || pageblocks <= 0 || shardcount <= 0 ) return false;
+
+	m_blocksize = dev->ftkbioBlockSize();
+	m_blockcount = dev->ftkbioBlockCount();
+	if ( m_blocksize <= 0 ) return false;
+
+	m_pageblocks = pageblocks;
+	m_pagesize = pageblocks * m_blocksize;
+	m_maxbytes = maxbytes;
+
+	INT64 pages = maxbytes / m_pagesize;
+	if ( pages < shardcount ) shardcount = pages > 0 ? (int)pages : 1;
+	for(int i = 0; i < shardcount; i++) m_shards.push_back( new CShard( (int)(pages / shardcount), m_pagesize ) );
+
+	m_dev = dev;
+	setpinning(m_pinmask, m_maxpinnedbytes);
+	return true;
+}
+
+void CBlockCache::setpinning(unsigned int tagmask, INT64 maxpinnedbytes)
+{
+	m_pinmask = tagmask;
+	m_maxpinnedbytes = maxpinnedbytes;
+	if ( m_shards.empty() ) return;
+
+	int capacity = (int)(m_maxbytes / m_pagesize / (INT64)m_shards.size());
+	int pinnedcapacity = (int)(maxpinnedbytes / m_pagesize / (INT64)m_shards.size());
+	for(unsigned int i = 0; i < m_shards.size(); i++)
+	{
+		m_shards[i]->lock();
+		m_shards[i]->setcapacity(capacity, pinnedcapacity);
+		m_shards[i]->unlock();
+	}
+}
+
+void CBlockCache::flushcache()
+{
+	for(unsigned int i = 0; i < m_shards.size(); i++)
+	{
+		m_shards[i]->lock();
+		m_shards[i]->clear();
+		m_shards[i]->unlock();
+	}
+}
+
+void CBlockCache::getstats(SBlockCacheStats &stats)
+{
+	stats.clear();
+	for(unsigned int i = 0; i < m_shards.size(); i++)
+	{
+		CShard *s = m_shards[i];
+		s->lock();
+		for(int t = 0; t < iotagCOUNT; t++)
+		{
+			stats.hits[t] += s->m_hits[t];
+			stats.misses[t] += s->m_misses[t];
+		}
+		stats.evictions += s->m_evictions;
+		stats.pages += s->m_sizes[CShard::T1] + s->m_sizes[CShard::T2] + s->m_sizes[CShard::PINNED];
+		stats.pinnedpages += s->m_sizes[CShard::PINNED];
+		s->unlock();
+	}
+}
+
+void CBlockCache::resetstats()
+{
+	for(unsigned int i = 0; i < m_shards.size(); i++)
+	{
+		CShard *s = m_shards[i];
+		s->lock();
+		memset(s->m_hits, 0, sizeof(s->m_hits));
+		memset(s->m_misses, 0, sizeof(s->m_misses));
+		s->m_evictions = 0;
+		s->unlock();
+	}
+}
+
+int CBlockCache::pageblocks(fssize_t pagenum) const
+{
+	fssize_t left = m_blockcount - pagenum * m_pageblocks;
+	return left < m_pageblocks ? (int)left : m_pageblocks;
+}
+
+bool CBlockCache::readcached(fssize_t pagenum, int offset, int length, char *dest)
+{
+	CShard *s = shard(pagenum);
+	EIOTag tag = IOTagGet();
+
+	s->lock();
+	const char *data = s->lookup(pagenum, IOHintGet() != iohintBULK);
+	if ( data ) { memcpy(dest, data + offset, length); s->m_hits[tag]++; }
+	else s->m_misses[tag]++;
+	s->unlock();
+
+	return data != NULL;
+}
+
+bool CBlockCache::ismissing(fssize_t pagenum)
+{
+	CShard *s = shard(pagenum);
+
+	s->lock();
+	bool missing = !s->contains(pagenum);
+	if ( missing ) s->m_misses[IOTagGet()]++;
+	s->unlock();
+
+	return missing;
+}
+
+void CBlockCache::cachepage(fssize_t pagenum, const char *data)
+{
+	CShard *s = shard(pagenum);
+	EIOHint hint = IOHintGet();
+	bool pin = hint == iohintMETADATA || (m_pinmask & (1u << IOTagGet())) != 0;
+
+	s->lock();
+	if ( hint == iohintBULK ) s->insertring(pagenum, data);
+	else s->insert(pagenum, data, pin);
+	s->unlock();
+}
+
+bool CBlockCache::loadpage(fssize_t pagenum, char *dest)
+{
+	int n = pageblocks(pagenum);
+	if ( n <= 0 ) return false;
+
+	if ( n < m_pageblocks ) memset(dest + n * m_blocksize, 0, m_pagesize - n * m_blocksize);
+	if ( m_dev->ftkbioBlockReadN(dest, pagenum * m_pageblocks, n) != n ) return false;
+
+	cachepage(pagenum, dest);
+	return true;
+}
+
+//
+// CFTKBlockDevice methods
+//
+bool CBlockCache::ftkbioBlockRead(void *dest, fssize_t blocknum, int startoffset, int bytestoread)
+{
+	if ( !isvalid() || !dest || blocknum < 0 ) return false;
+	if ( bytestoread < 0 ) bytestoread = m_blocksize - startoffset;
+	if ( startoffset < 0 || startoffset + bytestoread > m_blocksize ) return false;
+
+	fssize_t pagenum = blocknum / m_pageblocks;
+	int offset = (int)(blocknum % m_pageblocks) * m_blocksize + startoffset;
+	if ( readcached(pagenum, offset, bytestoread, (char *)dest) ) return true;
+
+	char *page = (char *)malloc(m_pagesize);
+	if ( !page ) return m_dev->ftkbioBlockRead(dest, blocknum, startoffset, bytestoread);
+
+	bool result = loadpage(pagenum, page);
+	if ( result ) memcpy(dest, page + offset, bytestoread);
+	free(page);
+
+	// if the page as a whole couldn't be read, the block on its own might still be
+	return result || m_dev->ftkbioBlockRead(dest, blocknum, startoffset, bytestoread);
+}
+
+int CBlockCache::ftkbioBlockReadN(void *dest, fssize_t startblocknum, int count)
+{
+	if ( !isvalid() || !dest || startblocknum < 0 ) return -1;
+
+	char *cdest = (char *)dest;
+	char *page = NULL;
+	int done = 0;
+	while ( done < count )
+	{
+		fssize_t blocknum = startblocknum + done;
+		fssize_t pagenum = blocknum / m_pageblocks;
+		int pageofs = (int)(blocknum % m_pageblocks);
+		int n = ad_min(m_pageblocks - pageofs, count - done);
+		char *d = cdest + done * m_blocksize;
+
+		if ( readcached(pagenum, pageofs * m_blocksize, n * m_blocksize, d) ) { done += n; continue; }
+
+		if ( pageofs == 0 && n == m_pageblocks )
+		{
+			// whole pages go straight into dest, along with any uncached whole pages after it
+			int pages = 1;
+			while ( done + (pages+1) * m_pageblocks <= count && ismissing(pagenum + pages) ) pages++;
+
+			int r = m_dev->ftkbioBlockReadN(d, blocknum, pages * m_pageblocks);
+			if ( r <= 0 ) break;
+			for(int i = 0; i < r / m_pageblocks; i++) cachepage(pagenum + i, d + i * m_pagesize);
+			done += r;
+			if ( r < pages * m_pageblocks ) break;
+			continue;
+		}
+
+		// part of a page, read the whole page so the rest of it gets cached too
+		if ( !page && (page = (char *)malloc(m_pagesize)) == NULL ) break;
+		if ( !loadpage(pagenum, page) )
+		{
+			int r = m_dev->ftkbioBlockReadN(d, blocknum, n);
+			if ( r > 0 ) done += r;
+			break;
+		}
+		memcpy(d, page + pageofs * m_blocksize, n * m_blocksize);
+		done += n;
+	}
+
+	if ( page ) free(page);
+	return done;
+}
+
+int CBlockCache::ftkbioBlockReadV(const SIOVec *iov, int iovcount, fssize_t startblocknum)
+{
+	if ( !isvalid() || !iov || startblocknum < 0 ) return -1;
+
+	// cut the buffers into pages and fill in what's cached, stopping at the end of the device
+	vector<SReadVPiece> pieces;
+	vector<SReadVPage> pages;
+	fssize_t blocknum = startblocknum;
+	for(int i = 0; i < iovcount && blocknum < m_blockcount; i++)
+	{
+		char *d = (char *)iov[i].base;
+		int left = iov[i].length / m_blocksize;
+		while ( left > 0 && blocknum < m_blockcount )
+		{
+			fssize_t pagenum = blocknum / m_pageblocks;
+			int pageofs = (int)(blocknum % m_pageblocks);
+			int n = ad_min(ad_min(m_pageblocks - pageofs, left), pageblocks(pagenum) - pageofs);
+
+			SReadVPiece piece;
+			piece.offset = pageofs * m_blocksize;
+			piece.length = n * m_blocksize;
+			piece.dest = d;
+			piece.done = readcached(pagenum, piece.offset, piece.length, d);
+
+			if ( pages.empty() || pages.back().pagenum != pagenum )
+			{
+				SReadVPage page;
+				page.pagenum = pagenum;
+				page.firstpiece = pieces.size();
+				page.piececount = 0;
+				page.missing = false;
+				page.direct = false;
+				pages.push_back(page);
+			}
+			pages.back().piececount++;
+			if ( !piece.done ) pages.back().missing = true;
+			pieces.push_back(piece);
+
+			d += piece.length;
+			blocknum += n;
+			left -= n;
+		}
+	}
+
+	// Each run of missing pages is one vectored device read.  A page that fills a
+	// buffer piece on its own is read straight into it, the others go through a
+	// scratch page so they can be cached whole.
+	unsigned int p = 0;
+	while ( p < pages.size() )
+	{
+		if ( !pages[p].missing ) { p++; continue; }
+
+		unsigned int end = p;
+		int scratchpages = 0;
+		for(; end < pages.size() && pages[end].missing; end++)
+		{
+			SReadVPage &page = pages[end];
+			page.direct = page.piececount == 1 && pieces[page.firstpiece].length == m_pagesize && pageblocks(page.pagenum) == m_pageblocks;
+			if ( !page.direct ) scratchpages++;
+		}
+
+		char *scratch = scratchpages > 0 ? (char *)malloc(scratchpages * m_pagesize) : NULL;
+		if ( scratchpages > 0 && !scratch ) break;
+
+		vector<SIOVec> vec;
+		vector<char*> pagedata;
+		int runblocks = 0;
+		char *nextscratch = scratch;
+		for(unsigned int i = p; i < end; i++)
+		{
+			const SReadVPage &page = pages[i];
+			int n = pageblocks(page.pagenum);
+			if ( n <= 0 ) break;
+
+			char *data;
+			if ( page.direct ) data = pieces[page.firstpiece].dest;
+			else
+			{
+				data = nextscratch;
+				nextscratch += m_pagesize;
+				if ( n < m_pageblocks ) memset(data + n * m_blocksize, 0, m_pagesize - n * m_blocksize);
+			}
+
+			SIOVec v;
+			v.base = data;
+			v.length = n * m_blocksize;
+			vec.push_back(v);
+			pagedata.push_back(data);
+			runblocks += n;
+		}
+
+		int r = vec.empty() ? -1 : m_dev->ftkbioBlockReadV(&vec[0], vec.size(), pages[p].pagenum * m_pageblocks);
+
+		// cache and hand out the pages that came back whole
+		int pageend = 0;
+		for(unsigned int i = 0; i < pagedata.size(); i++)
+		{
+			pageend += vec[i].length / m_blocksize;
+			if ( pageend > r ) break;
+
+			const SReadVPage &page = pages[p + i];
+			cachepage(page.pagenum, pagedata[i]);
+			for(int j = page.firstpiece; j < page.firstpiece + page.piececount; j++)
+			{
+				SReadVPiece &piece = pieces[j];
+				if ( pagedata[i] != piece.dest ) memcpy(piece.dest, pagedata[i] + piece.offset, piece.length);
+				piece.done = true;
+			}
+		}
+
+		if ( scratch ) free(scratch);
+		if ( r < runblocks ) break;
+		p = end;
+	}
+
+	// like ReadN, only the blocks up to the first one that couldn't be read count
+	int done = 0;
+	for(unsigned int i = 0; i < pieces.size() && pieces[i].done; i++) done += pieces[i].length / m_blocksize;
+	return done;
+}
+
+int CBlockCache::ftkbioBlockSize() const
+{
+	return isvalid() ? m_dev->ftkbioBlockSize() : FTKBIOERROR;
+}
+
+int CBlockCache::ftkbioPhysicalBlockSize() const
+{
+	return isvalid() ? m_dev->ftkbioPhysicalBlockSize() : FTKBIOERROR;
+}
+
+fssize_t CBlockCache::ftkbioFirstBlockNum() const
+{
+	return isvalid() ? m_dev->ftkbioFirstBlockNum() : FTKBIOERROR;
+}
+
+fssize_t CBlockCache::ftkbioBlockCount() const
+{
+	return isvalid() ? m_dev->ftkbioBlockCount() : FTKBIOERROR;
+}
+
+bool CBlockCache::ftkbioIsPhysicalDevice() const
+{
+	return isvalid() ? m_dev->ftkbioIsPhysicalDevice() : false;
+}
+
+fssize_t CBlockCache::ftkbioBlockNumTranslate(fssize_t blocknum, CFTKBlockDevice *dev) const
+{
+	if ( !isvalid() ) return FTKBIOERROR;
+	if ( dev == (CFTKBlockDevice*)this ) return blocknum;
+
+	return m_dev->ftkbioBlockNumTranslate(blocknum, dev);
+}
+
+CFTKBlockDevice::EVerifyResult CBlockCache::ftkbioVerify(CJobCallBack &callback)
+{
+	return isvalid() ? m_dev->ftkbioVerify(callback) : VERIFY_NOT_SUPPORTED;
+}
+
+bool CBlockCache::ftkbioVerifySupported()
+{
+	return isvalid() ? m_dev->ftkbioVerifySupported() : false;
+}
+
+void CBlockCache::ftkbioFlush()
+{
+	flushcache();
+	if ( m_dev ) m_dev->ftkbioFlush();
+}
+
+bool CBlockCache::ftkMetaDataListPopulate(CFTKMetaDataList &mdlist)
+{
+	return isvalid() ? m_dev->ftkMetaDataListPopulate(mdlist) : false;
+}
+
+};		// end namespace
@@ -0,0 +1,154 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include "ADIOBlockDevice.h"
+#include "IOStats.h"
+#include <vector>
+
+namespace AccessData
+{
+
+using std::vector;
+
+// SBlockCacheStats
+// Page lookups, by the I/O tag of the read that made them.
+struct SBlockCacheStats
+{
+	INT64		hits[iotagCOUNT];
+	INT64		misses[iotagCOUNT];
+	INT64		evictions;				// pages dropped to make room
+	INT64		pages;					// pages currently cached, including pinned ones
+	INT64		pinnedpages;
+
+	void		clear();
+	// hits / (hits + misses) for one tag, or for all of them if tag is -1.  0 if there were no lookups.
+	double		hitratio(int tag = -1) const;
+};
+
+// CBlockCache
+// A read cache that sits between a filesystem and its block device.  The cache
+// holds pages of pageblocks device blocks (use the cluster size) and is split into
+// shards, each with its own lock, so threads reading different pages don't contend.
+// Eviction is ARC: a page read once goes on a recency list and only moves to the
+// frequency list when it's read again, so a long scan can't push out pages that
+// are used over and over (MFT records, index nodes).  On top of that, pages read
+// under a pinned tag (see setpinning()) or with iohintMETADATA are kept until the
+// cache is cleared, up to their own limit.
+// Reads made with iohintBULK are served from cached pages when they're there, but
+// don't count as a use of them, and what they read only goes into a small ring of
+// pages per shard, so bulk file reads can't flush the metadata.
+// ftkbioBlockReadV() fills what it can from cached pages and reads each run of
+// missing pages with a single vectored read from the device below.
+// The device below is only ever called without a shard lock held.
+class CBlockCache : public CFTKBlockDevice
+{
+public:
+	CBlockCache();
+	~CBlockCache();
+
+	bool			isvalid() const;
+	void			clear();
+
+	// attach()
+	// Starts caching reads from dev, dropping anything cached from a previous device.
+	// maxbytes caps the cached page data (pinned pages included).  Doesn't take ownership of dev.
+	bool			attach(CFTKBlockDevice *dev, int pageblocks, INT64 maxbytes, int shardcount = 8);
+	CFTKBlockDevice* getdev() const		{ return m_dev; }
+
+	// setpinning()
+	// Pages first read with iohintMETADATA, or under a tag whose bit is set in tagmask (bit n is EIOTag n) are pinned,
+	// until maxpinnedbytes worth are pinned.  After that they're cached like any other page.
+	// Only affects pages read after the call.
+	void			setpinning(unsigned int tagmask, INT64 maxpinnedbytes);
+
+	// Drops all cached pages, but stays attached.
+	void			flushcache();
+
+	void			getstats(SBlockCacheStats &stats);
+	void			resetstats();
+
+	//
+	// CFTKBlockDevice methods
+	//
+	bool			ftkbioBlockRead(void *dest, fssize_t blocknum, int startoffset=0, int bytestoread=-1);
+	int				ftkbioBlockReadN(void *dest, fssize_t startblocknum, int count);
+	int				ftkbioBlockReadV(const SIOVec *iov, int iovcount, fssize_t startblocknum);
+	int				ftkbioBlockSize() const;
+	int				ftkbioPhysicalBlockSize() const;
+	fssize_t		ftkbioFirstBlockNum() const;
+	fssize_t		ftkbioBlockCount() const;
+	bool			ftkbioIsPhysicalDevice() const;
+	fssize_t		ftkbioBlockNumTranslate(fssize_t blocknum, CFTKBlockDevice *dev) const;
+	EVerifyResult	ftkbioVerify(CJobCallBack &callback);
+	bool			ftkbioVerifySupported();
+	void			ftkbioFlush();
+
+	bool			ftkMetaDataListPopulate(CFTKMetaDataList &mdlist);
+protected:
+	class CShard;
+
+	CShard*			shard(fssize_t pagenum) const	{ return m_shards[(int)(pagenum % m_shards.size())]; }
+	// copy part of a page out of the cache.  false if the page isn't cached
+	bool			readcached(fssize_t pagenum, int offset, int length, char *dest);
+	// true (and counts a miss) if the page isn't cached.  Doesn't count as a use of a cached page.
+	bool			ismissing(fssize_t pagenum);
+	// read a page from m_dev and cache it.  false if the device read fails
+	bool			loadpage(fssize_t pagenum, char *dest);
+	// add a page that was read from m_dev to the cache
+	void			cachepage(fssize_t pagenum, const char *data);
+	// the number of blocks in a page, the last page on the device may be short
+	int				pageblocks(fssize_t pagenum) const;
+
+	CFTKBlockDevice*	m_dev;
+	vector<CShard*>		m_shards;
+	int					m_pageblocks;		// device blocks per page
+	int					m_pagesize;			// in bytes
+	int					m_blocksize;		// m_dev's block size
+	fssize_t			m_blockcount;		// m_dev's block count
+	INT64				m_maxbytes;
+	unsigned int		m_pinmask;			// tags whose pages get pinned
+	INT64				m_maxpinnedbytes;
+private:
+	void initfields();
+	void clearfields();
+
+	typedef CFTKBlockDevice inherited;
+	CBlockCache(const CBlockCache &rhs);				// disallow
+	CBlockCache &operator=(const CBlockCache &rhs);	// disallow
+};
+
+};		// end namespace
+
+#endif
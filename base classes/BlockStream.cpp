@@ -31,42 +31,102 @@
 #include "BlockStream.h"
 #include "Logger.h"
 
+#include <windows.h>
 #include <assert.h>
+#include <malloc.h>
+#include <string.h>
+#include <algorithm>
 
 namespace AccessData
 {
 
+CBlockStream::CRunList *CBlockStream::CRunList::Create()
+{
+	return new CRunList;
+}
+
+CBlockStream::CRunList *CBlockStream::CRunList::AddRef()
+{
+	InterlockedIncrement( (long *)&m_refcount );
+	return this;
+}
+
+void CBlockStream::CRunList::Release()
+{
+	if ( InterlockedDecrement( (long *)&m_refcount ) == 0 ) delete this;
+}
+
+//-----------------------------------------------------------------------------
+
 void CBlockStream::initfields()
 {
 	m_dev = NULL;
-    //m_runs.clear();
+	m_runlist = NULL;
+	m_firstrun = 0;
+	m_runcount = 0;
+	m_runbase = 0;
+	m_lastrun = -1;
 	m_bc = 0;
 	m_size = 0;
     m_blocksize = 0;
 	m_initialoffset = 0;
 	m_cp = 0;
+	m_iotag = iotagOTHER;
+	m_iohint = iohintNONE;
+	m_raminbytes = 0;
+	m_ramaxbytes = 0;
+	m_rabuffer = NULL;
+	m_rabuffersize = 0;
+	m_rafirst = 0;
+	m_racount = 0;
+	m_ranextpos = -1;
+	memset(&m_rastats, 0, sizeof(m_rastats));
 }
 
 void CBlockStream::clearfields()
 {
 	m_dev = NULL;
-	m_runs.clear();
+	if ( m_runlist ) m_runlist->Release();
+	m_runlist = NULL;
+	m_firstrun = 0;
+	m_runcount = 0;
+	m_runbase = 0;
+	m_lastrun = -1;
 	m_bc = 0;
 	m_size = 0;
     m_blocksize = 0;
 	m_initialoffset = 0;
 	m_cp = 0;
+	m_iotag = iotagOTHER;
+	m_iohint = iohintNONE;
+	m_raminbytes = 0;
+	m_ramaxbytes = 0;
+	if ( m_rabuffer ) free(m_rabuffer);
+	m_rabuffer = NULL;
+	m_rabuffersize = 0;
+	m_rafirst = 0;
+	m_racount = 0;
+	m_ranextpos = -1;
+	memset(&m_rastats, 0, sizeof(m_rastats));
 }
 
 void CBlockStream::assignfields(const CBlockStream &rhs)
 {
 	m_dev = rhs.m_dev;
-	m_runs = rhs.m_runs;
+	m_runlist = rhs.m_runlist ? rhs.m_runlist->AddRef() : NULL;
+	m_firstrun = rhs.m_firstrun;
+	m_runcount = rhs.m_runcount;
+	m_runbase = rhs.m_runbase;
+	m_lastrun = rhs.m_lastrun;
 	m_bc = rhs.m_bc;
 	m_size = rhs.m_size;
     m_blocksize = rhs.m_blocksize;
 	m_initialoffset = rhs.m_initialoffset;
 	m_cp = rhs.m_cp;
+	m_iotag = rhs.m_iotag;
+	m_iohint = rhs.m_iohint;
+	m_raminbytes = rhs.m_raminbytes;
+	m_ramaxbytes = rhs.m_ramaxbytes;
 }
 
 CBlockStream::CBlockStream()
@@ -111,12 +171,16 @@ CBlockStream &CBlockStream::operator=(const CBlockStream &rhs)
 
 bool CBlockStream::AddRun(INT64 startblock, INT64 blockcount)
 {
+	if ( !makeunique() ) return false;
+
 	runinfo temp;
 	temp.logicalstart = m_bc;
 	temp.physicalstart = startblock;
 	temp.count = blockcount;
 
-	m_runs.push_back( temp );
+	m_runlist->runs.push_back( temp );
+	m_runlist->starts.push_back( temp.logicalstart );
+	m_runcount++;
 
 	m_bc += blockcount;
 
@@ -125,15 +189,52 @@ bool CBlockStream::AddRun(INT64 startblock, INT64 blockcount)
 
 bool CBlockStream::GetRunInfo(int runnum, INT64 &logicalstart, INT64 &physicalstart, INT64 &length)
 {
-	if ( runnum < 0 || runnum >= m_runs.size() ) return false;
+	if ( runnum < 0 || runnum >= m_runcount ) return false;
+
+	// clip the run to the part of the list that this stream uses
+	const runinfo &run = m_runlist->runs[m_firstrun+runnum];
+	INT64 start = run.logicalstart > m_runbase ? run.logicalstart : m_runbase;
+	INT64 end = ad_min(run.logicalstart+run.count, m_runbase+m_bc);
 
-    logicalstart = m_runs[runnum].logicalstart;
-    physicalstart = m_runs[runnum].physicalstart;
-    length = m_runs[runnum].count;
+    logicalstart = start - m_runbase;
+    physicalstart = run.physicalstart == -1 ? -1 : run.physicalstart + (start - run.logicalstart);
+    length = end - start;
 
     return true;
 }
 
+bool CBlockStream::makeunique()
+{
+	if ( !m_runlist )
+	{
+		m_runlist = CRunList::Create();
+		return m_runlist != NULL;
+	}
+
+	bool isslice = m_runbase != 0 || m_firstrun != 0 || m_runcount != (int)m_runlist->runs.size();
+	if ( !m_runlist->isshared() && !isslice ) return true;
+
+	CRunList *newlist = CRunList::Create();
+	if ( !newlist ) return false;
+
+	newlist->runs.reserve( m_runcount );
+	newlist->starts.reserve( m_runcount );
+	for(int i=0; i < m_runcount; i++)
+	{
+		runinfo temp;
+		GetRunInfo(i, temp.logicalstart, temp.physicalstart, temp.count);
+		newlist->runs.push_back( temp );
+		newlist->starts.push_back( temp.logicalstart );
+	}
+
+	m_runlist->Release();
+	m_runlist = newlist;
+	m_firstrun = 0;
+	m_runbase = 0;
+	m_lastrun = -1;
+	return true;
+}
+
 void CBlockStream::SetDev(CFTKBlockDevice *dev)
 {
 	m_dev = dev;
@@ -156,6 +257,28 @@ void CBlockStream::SetInitialOffset(int initialoffset)
 	m_initialoffset = initialoffset;
 }
 
+void CBlockStream::SetReadAhead(int minbytes, int maxbytes)
+{
+	if ( minbytes < 0 ) minbytes = 0;
+	if ( maxbytes < minbytes ) maxbytes = minbytes;
+
+	m_raminbytes = minbytes;
+	m_ramaxbytes = maxbytes;
+	m_rastats.window = 0;
+	m_racount = 0;
+	if ( m_ramaxbytes == 0 && m_rabuffer )
+	{
+		free(m_rabuffer);
+		m_rabuffer = NULL;
+		m_rabuffersize = 0;
+	}
+}
+
+void CBlockStream::GetReadAheadStats(SReadAheadStats &stats) const
+{
+	stats = m_rastats;
+}
+
 
 bool CBlockStream::MakeSubFile(CBlockStream *f, INT64 pos, INT64 count)
 {
@@ -172,21 +295,21 @@ bool CBlockStream::MakeSubFile(CBlockStream *f, INT64 pos, INT64 count)
 	INT64 startb = pos / m_blocksize;
 	INT64 newbc = div_roundup( count+newofs, (INT64)m_blocksize );
 
-	int i, runcount = m_runs.size();
-
 	// find the run that houses our starting block
-	for(i=0; i < runcount && startb >= m_runs[i].count; startb -= m_runs[i].count, i++) { /*nada*/ }
-	if ( i >= runcount ) return false;
+	int first = findrun(startb);
+	if ( first < 0 ) return false;
+
+	// and the run that houses our last block
+	int last = newbc > 0 ? findrun(startb+newbc-1) : first-1;
+	if ( newbc > 0 && last < 0 ) return false;
+
+	// f becomes a window onto our run list
+	f->m_runlist = m_runlist->AddRef();
+	f->m_firstrun = first;
+	f->m_runcount = last - first + 1;
+	f->m_runbase = m_runbase + startb;
+	f->m_bc = newbc;
 
-	// add whole runs to f's runlist until we take all the blocks we need
-	for(; i < runcount && newbc > 0; i++)
-	{
-		INT64 x = min(m_runs[i].count-startb, newbc); // ? m_runs[i].count-startb : newbc;
-		f->AddRun( m_runs[i].physicalstart+startb, x );
-		newbc -= x;
-		startb = 0;
-	}
-	
 	f->SetDev( m_dev );
 	f->SetLength( count );
 	f->SetInitialOffset( newofs );
@@ -245,24 +368,48 @@ int CBlockStream::Read(void *dest, int bytestoread, INT64 pos)
     // here pos is now physical after being adjusted by m_initialoffset
     pos += m_initialoffset;
 
+	CIOTagScope iotag(m_iotag, m_iohint);
+
+	// anything that doesn't pick up where the last read left off (and isn't already
+	// buffered) is random access, so stop reading ahead until it's sequential again
+	bool sequential = pos == m_ranextpos;
+	if ( !sequential && !rahas(pos / m_blocksize) ) m_rastats.window = 0;
+
 	while ( bytestoread > 0 )
 	{
-		//INT64 apos = pos+m_initialoffset;				// adjusted pos... not needed anymore
 		int startofs = pos % m_blocksize;				// offset from the beginning of this block... only the 1st block should be non-zero
 		int b = ad_min(m_blocksize - startofs, bytestoread);// bytes to read out of this block, the min of bs-startofs or the number of bytes left to read
-		INT64 blocknum;
-		if ( !blocknumxlat(blocknum, pos / m_blocksize) ) break;	// map the block num from local sequential blocks into the device blocks
+		INT64 logicalblocknum = pos / m_blocksize;
 
-		if ( blocknum < 0 )								// if its a sparse block
+		// runs of whole blocks bigger than the readahead window go straight into dest
+		int wholeblocks = startofs == 0 ? bytestoread / m_blocksize : 0;
+		if ( wholeblocks > 1 && !rahas(logicalblocknum) && (!sequential || wholeblocks >= m_rastats.window) )
 		{
-			memset(cdest, 0, b);
+			int n = readblocks(cdest, logicalblocknum, wholeblocks);
+			if ( n <= 0 ) break;
+			m_rastats.misses += n;
+			b = n * m_blocksize;
 		}
-		else
+		else if ( rahas(logicalblocknum) || (sequential && rafill(logicalblocknum)) )
 		{
-			if ( !m_dev->ftkbioBlockRead( cdest, blocknum, startofs, b) ) break;
+			memcpy( cdest, m_rabuffer + (logicalblocknum - m_rafirst) * m_blocksize + startofs, b );
+			m_rastats.hits++;
 		}
+		else
+		{
+			INT64 blocknum;
+			if ( !blocknumxlat(blocknum, logicalblocknum) ) break;	// map the block num from local sequential blocks into the device blocks
 
-		//memcpy( cdest, m_blockbuffer+startofs, b );
+			if ( blocknum < 0 )								// if its a sparse block
+			{
+				memset(cdest, 0, b);
+			}
+			else
+			{
+				if ( !m_dev->ftkbioBlockRead( cdest, blocknum, startofs, b) ) break;
+			}
+			m_rastats.misses++;
+		}
 
 		pos += b;
 		cdest += b;
@@ -270,9 +417,236 @@ int CBlockStream::Read(void *dest, int bytestoread, INT64 pos)
 		bytestoread -= b;
 	}
 
+	m_ranextpos = pos;
+	return totalbytesread;
+}
+
+bool CBlockStream::NextDataRange(INT64 pos, INT64 &datapos, INT64 &datalength) const
+{
+	if ( !isvalid() ) return false;
+	if ( pos < 0 ) pos = 0;
+
+	const RUNINFOLIST &runs = m_runlist->runs;
+	int endrun = m_firstrun+m_runcount;
+
+	while ( pos < m_size )
+	{
+		int m = findrun( (pos + m_initialoffset) / m_blocksize );
+		if ( m < 0 ) return false;
+
+		// where this run ends, as a position in this stream
+		INT64 runend = (runs[m].logicalstart + runs[m].count - m_runbase) * m_blocksize - m_initialoffset;
+		if ( runs[m].physicalstart == -1 )
+		{
+			pos = runend;
+			continue;
+		}
+
+		for(m++; m < endrun && runs[m].physicalstart != -1; m++)
+			runend = (runs[m].logicalstart + runs[m].count - m_runbase) * m_blocksize - m_initialoffset;
+
+		datapos = pos;
+		datalength = ad_min(runend, m_size) - pos;
+		return true;
+	}
+	return false;
+}
+
+int CBlockStream::ReadExtents(INT64 pos, INT64 length, vector<SStreamExtent> &extents) const
+{
+	extents.clear();
+	if ( pos < 0 || length <= 0 ) return 0;
+
+	INT64 end = ad_min(pos + length, Length());
+	while ( pos < end )
+	{
+		INT64 datapos, datalength;
+		if ( !NextDataRange(pos, datapos, datalength) || datapos >= end )
+		{
+			datapos = end;
+			datalength = 0;
+		}
+
+		SStreamExtent extent;
+		if ( datapos > pos )
+		{
+			extent.pos = pos;
+			extent.length = datapos - pos;
+			extent.hole = true;
+			extents.push_back(extent);
+		}
+		if ( datalength > 0 )
+		{
+			extent.pos = datapos;
+			extent.length = ad_min(datapos + datalength, end) - datapos;
+			extent.hole = false;
+			extents.push_back(extent);
+		}
+		pos = datalength > 0 ? extent.pos + extent.length : datapos;
+	}
+	return extents.size();
+}
+
+int CBlockStream::ReadV(const SIOVec *iov, int count, INT64 pos)
+{
+	if ( !iov || count < 0 || !isvalid() ) return -1;
+	if ( pos < 0 || pos >= m_size ) return 0;
+
+	CIOTagScope iotag(m_iotag, m_iohint);
+
+	int totalbytesread = 0;
+	int i = 0;						// the buffer we're filling
+	int ofs = 0;					// and how far into it we are
+	vector<SIOVec> batch;
+
+	while ( i < count && pos < m_size )
+	{
+		if ( ofs >= iov[i].length )
+		{
+			i++;
+			ofs = 0;
+			continue;
+		}
+
+		INT64 physpos = pos + m_initialoffset;
+		int avail = (int)ad_min( (INT64)(iov[i].length - ofs), m_size - pos );
+		int m = physpos % m_blocksize == 0 && avail >= m_blocksize ? findrun(physpos / m_blocksize) : -1;
+
+		// the ends that aren't whole blocks go through Read()
+		if ( m < 0 )
+		{
+			int b = ad_min( avail, m_blocksize - (int)(physpos % m_blocksize) );
+			int r = Read( (char *)iov[i].base + ofs, b, pos );
+			if ( r <= 0 ) break;
+			totalbytesread += r;
+			pos += r;
+			ofs += r;
+			if ( r < b ) break;
+			continue;
+		}
+
+		// gather the whole blocks this run covers from as many buffers as it takes
+		const runinfo &run = m_runlist->runs[m];
+		INT64 runofs = physpos / m_blocksize + m_runbase - run.logicalstart;
+		INT64 runleft = run.count - runofs;
+		INT64 batchpos = pos;
+		int blocks = 0;
+
+		batch.clear();
+		for(int bi = i, bofs = ofs; blocks < runleft && bi < count; bi++, bofs = 0)
+		{
+			INT64 room = ad_min( (INT64)(iov[bi].length - bofs), m_size - batchpos );
+			int n = (int)ad_min( room / m_blocksize, runleft - blocks );
+			if ( n <= 0 )
+			{
+				if ( iov[bi].length - bofs <= 0 ) continue;	// skip empty buffers
+				break;
+			}
+
+			SIOVec v;
+			v.base = (char *)iov[bi].base + bofs;
+			v.length = n * m_blocksize;
+			batch.push_back(v);
+
+			blocks += n;
+			batchpos += v.length;
+			if ( bofs + v.length < iov[bi].length ) break;
+		}
+
+		int r = blocks;
+		if ( run.physicalstart == -1 )						// sparse
+		{
+			for(unsigned int j = 0; j < batch.size(); j++) memset(batch[j].base, 0, batch[j].length);
+		}
+		else
+		{
+			r = m_dev->ftkbioBlockReadV(&batch[0], batch.size(), run.physicalstart + runofs);
+			if ( r <= 0 ) break;
+		}
+		m_rastats.misses += r;
+
+		// step past what was read
+		INT64 bytes = (INT64)r * m_blocksize;
+		totalbytesread += (int)bytes;
+		pos += bytes;
+		while ( bytes > 0 )
+		{
+			int step = (int)ad_min( (INT64)(iov[i].length - ofs), bytes );
+			ofs += step;
+			bytes -= step;
+			if ( ofs >= iov[i].length )
+			{
+				i++;
+				ofs = 0;
+			}
+		}
+		if ( r < blocks ) break;
+	}
+
+	m_ranextpos = pos + m_initialoffset;
 	return totalbytesread;
 }
 
+int CBlockStream::readblocks(char *dest, INT64 logicalblocknum, int count)
+{
+	int done = 0;
+	while ( done < count )
+	{
+		int m = findrun(logicalblocknum + done);
+		if ( m < 0 ) break;
+
+		const runinfo &run = m_runlist->runs[m];
+		INT64 runofs = logicalblocknum + done + m_runbase - run.logicalstart;
+		int n = (int)ad_min( (INT64)(count - done), run.count - runofs );
+		char *d = dest + (INT64)done * m_blocksize;
+
+		if ( run.physicalstart == -1 )					// sparse
+		{
+			memset(d, 0, n * m_blocksize);
+		}
+		else
+		{
+			int r = m_dev->ftkbioBlockReadN(d, run.physicalstart + runofs, n);
+			if ( r <= 0 ) break;
+			if ( r < n ) { done += r; break; }
+		}
+		done += n;
+	}
+	return done;
+}
+
+bool CBlockStream::rafill(INT64 logicalblocknum)
+{
+	if ( m_ramaxbytes <= 0 ) return false;
+
+	// start small and double the window every time the caller reads through it
+	int minblocks = m_raminbytes / m_blocksize > 0 ? m_raminbytes / m_blocksize : 1;
+	int maxblocks = m_ramaxbytes / m_blocksize > minblocks ? m_ramaxbytes / m_blocksize : minblocks;
+	int window = m_rastats.window == 0 ? minblocks : ad_min(m_rastats.window * 2, maxblocks);
+	if ( window > m_bc - logicalblocknum ) window = (int)(m_bc - logicalblocknum);
+	if ( window <= 0 ) return false;
+
+	if ( window > m_rabuffersize )
+	{
+		char *newbuffer = (char *)realloc(m_rabuffer, window * m_blocksize);
+		if ( !newbuffer ) return false;
+		m_rabuffer = newbuffer;
+		m_rabuffersize = window;
+	}
+
+	m_racount = 0;
+	int n = readblocks(m_rabuffer, logicalblocknum, window);
+	if ( n <= 0 ) return false;
+
+	m_rafirst = logicalblocknum;
+	m_racount = n;
+	m_rastats.window = window;
+	if ( window > m_rastats.maxwindow ) m_rastats.maxwindow = window;
+	m_rastats.fills++;
+	m_rastats.prefetched += n;
+	return true;
+}
+
 bool CBlockStream::Eof()
 {
 	return m_cp >= m_size;
@@ -333,31 +707,49 @@ fssize_t CBlockStream::BlockNumberGet(fssize_t pos)
 }
 #endif
 
-bool CBlockStream::blocknumxlat(INT64 &physicalblocknum, INT64 logicalblocknum) const
+int CBlockStream::findrun(INT64 logicalblocknum) const
 {
-	if ( logicalblocknum >= m_bc ) return false;
+	if ( logicalblocknum < 0 || logicalblocknum >= m_bc ) return -1;
+
+	logicalblocknum += m_runbase;		// m_runlist is indexed by its own logical block numbers
+
+	const RUNINFOLIST &runs = m_runlist->runs;
+	int endrun = m_firstrun+m_runcount;
 
-	int l=0, r = m_runs.size()-1;
-	while ( l <= r )	// binary search for the blockindex
+	// Sequential reads almost always land in the same run as last time, or the next one
+	int m = m_lastrun;
+	if ( m >= m_firstrun && m < endrun )
 	{
-		int m = (l+r)/2;
-		fssize_t logicalend = m_runs[m].logicalstart + m_runs[m].count;
+		if ( runs[m].logicalstart <= logicalblocknum && logicalblocknum < runs[m].logicalstart + runs[m].count ) return m;
 
-		if ( m_runs[m].logicalstart <= logicalblocknum && logicalblocknum < logicalend )
+		m++;
+		if ( m < endrun && runs[m].logicalstart <= logicalblocknum && logicalblocknum < runs[m].logicalstart + runs[m].count )
 		{
-			if ( m_runs[m].physicalstart == -1 )
-				physicalblocknum = -1;	// sparse
-			else
-				physicalblocknum = m_runs[m].physicalstart+logicalblocknum-m_runs[m].logicalstart;
-			return true;
+			m_lastrun = m;
+			return m;
 		}
-
-		if ( logicalblocknum < m_runs[m].logicalstart )
-			r = m-1;
-		else
-			l = m+1;
 	}
-	return false;
+
+	// binary search the start index for the last run that starts at or before the block
+	const INT64 *starts = &m_runlist->starts[0];
+	m = (std::upper_bound(starts+m_firstrun, starts+endrun, logicalblocknum) - starts) - 1;
+	if ( m < m_firstrun || logicalblocknum >= runs[m].logicalstart + runs[m].count ) return -1;
+
+	m_lastrun = m;
+	return m;
+}
+
+bool CBlockStream::blocknumxlat(INT64 &physicalblocknum, INT64 logicalblocknum) const
+{
+	int m = findrun(logicalblocknum);
+	if ( m < 0 ) return false;
+
+	const runinfo &run = m_runlist->runs[m];
+	if ( run.physicalstart == -1 )
+		physicalblocknum = -1;	// sparse
+	else
+		physicalblocknum = run.physicalstart+(logicalblocknum+m_runbase)-run.logicalstart;
+	return true;
 }
 
 };		// end namespace
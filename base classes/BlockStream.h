@@ -33,6 +33,7 @@
 
 #include "ADStream.h"
 #include "ADIOBlockDevice.h"
+#include "IOStats.h"
 
 #include <vector>
 
@@ -41,6 +42,27 @@ namespace AccessData
 
 using std::vector;
 
+// SReadAheadStats
+// How well a CBlockStream's readahead is doing.  Counts are in blocks.
+struct SReadAheadStats
+{
+	int		window;				// current readahead window, 0 when the stream isn't being read sequentially
+	int		maxwindow;			// largest window used so far
+	INT64	hits;				// blocks copied out of the readahead buffer
+	INT64	misses;				// blocks read from the device on demand
+	INT64	fills;				// readahead device reads
+	INT64	prefetched;			// blocks read by readahead
+};
+
+// SStreamExtent
+// A range of bytes in a CBlockStream that is either backed by the device or is a hole (a sparse run, reads as zeros).
+struct SStreamExtent
+{
+	INT64	pos;
+	INT64	length;
+	bool	hole;
+};
+
 // CBlockStream
 // This is an readonly stream that is based on runs of blocks on a blockdevice.
 class CBlockStream : public CStream
@@ -70,18 +92,51 @@ public:
 	INT64				BlockCount() const { return m_bc; }
 
 	bool				AddRun(INT64 startblock, INT64 length);
-    int					RunCount() const { return m_runs.size(); }
+    int					RunCount() const { return m_runcount; }
     bool				GetRunInfo(int runnum, INT64 &logicalstart, INT64 &physicalstart, INT64 &length);
 
 	void				SetLength(INT64 asize);
 	void				SetInitialOffset(int ainitialoffset);
+	int					GetInitialOffset() const { return m_initialoffset; }
+
+	// The tag that device reads made by this stream are attributed to
+	void				SetIOTag(EIOTag tag)	{ m_iotag = tag; }
+	EIOTag				GetIOTag() const		{ return m_iotag; }
+	// How this stream's data is going to be read, passed down to any cache along with the tag
+	void				SetAccessHint(EIOHint hint)	{ m_iohint = hint; }
+	EIOHint				GetAccessHint() const		{ return m_iohint; }
+
+	// SetReadAhead()
+	// Once reads are seen to be sequential, the stream reads ahead of the caller, starting
+	// with a window of minbytes and doubling it each time it is used up, up to maxbytes.
+	// A read that isn't sequential drops the window back to nothing.  maxbytes = 0 turns
+	// readahead off.  Dup() and copies keep these settings but not the buffered data.
+	// Readahead is off until this is called.  Turn it on for streams that are read start to
+	// end (file contents); metadata streams are better served by the device's cache, and
+	// each stream with readahead on can hold a buffer of up to maxbytes.
+	enum { READAHEAD_MINBYTES = 16*1024, READAHEAD_MAXBYTES = 1024*1024 };
+	void				SetReadAhead(int minbytes = READAHEAD_MINBYTES, int maxbytes = READAHEAD_MAXBYTES);
+	void				GetReadAheadStats(SReadAheadStats &stats) const;
 
 	// mksubfile()
 	// Makes f a subset of the current file.
 	// (ie. mksubfile(f, 10, 100) would set f so that it was limited to the bytes from 10..109 in this file.
+	// f shares this stream's run list instead of copying the runs.
 	bool				MakeSubFile(CBlockStream *f, INT64 pos, INT64 count);
 
 
+	// NextDataRange()
+	// Finds the first bytes at or after pos that aren't in a hole, and sets datapos and datalength to
+	// that range (adjacent runs are merged).  Returns false if there's nothing but holes from pos to the
+	// end of the stream.  Callers that only care about the data can skip from one range to the next
+	// instead of reading the zeros in between.
+	virtual bool		NextDataRange(INT64 pos, INT64 &datapos, INT64 &datalength) const;
+
+	// ReadExtents()
+	// Fills extents with the data and hole ranges that cover length bytes from pos (clipped to the end of
+	// the stream), in order.  Doesn't read any data.  Returns the number of extents.
+	int					ReadExtents(INT64 pos, INT64 length, vector<SStreamExtent> &extents) const;
+
 	// Get the blocknumber (m_dev) that holds the byte at position pos.
 	INT64				GetBlock(INT64 pos) const;
 	INT64				GetBlock(INT64 pos, CFTKBlockDevice *dev) const;
@@ -94,6 +149,8 @@ public:
 
 	int					Read(void *dest, int bytestoread);
 	int					Read(void *dest, int bytestoread, INT64 pos);
+	// whole blocks go from each run straight into the caller's buffers, one device call per run
+	int					ReadV(const SIOVec *iov, int count, INT64 pos);
 
 	bool				Eof();
 	INT64				Seek(INT64 amount, SEEK_WHENCE whence);
@@ -108,18 +165,67 @@ protected:
 	};
 	typedef vector < runinfo > RUNINFOLIST;	// a list of runs of blocks where the file lives
 
+	// CRunList
+	// A reference counted run list.  Once a list is shared between streams (by Dup(), the copy ctor
+	// or MakeSubFile()) it is never modified again; AddRun() on a stream that doesn't own its whole
+	// list copies the runs it uses into a new list first.
+	class CRunList
+	{
+	public:
+		static CRunList*	Create();
+		CRunList*			AddRef();
+		void				Release();
+		bool				isshared() const	{ return m_refcount > 1; }
+
+		RUNINFOLIST			runs;
+		vector<INT64>		starts;				// runs[i].logicalstart, packed together so the binary search stays in cache
+	private:
+		volatile long		m_refcount;
+
+		CRunList() : m_refcount(1) { }
+		CRunList(const CRunList &rhs);				// disallow
+		CRunList &operator=(const CRunList &rhs);	// disallow
+	};
+
+	// find the index (in m_runlist) of the run that holds logicalblocknum, -1 if none
+	// checks the last run that was hit (and the one after it) before searching the whole list
+	int findrun(INT64 logicalblocknum) const;
+	// make sure m_runlist is a list that only this instance uses, and that it starts at block 0
+	bool makeunique();
 
 	// xlat a file block number (via the runlist) into a block number on m_dev
 	bool blocknumxlat(INT64 &physicalblocknum, INT64 logicalblocknum) const;
 
+	// read count whole blocks starting at logicalblocknum, one device read per run.  Returns the number of blocks read.
+	int readblocks(char *dest, INT64 logicalblocknum, int count);
+	// refill the readahead buffer starting at logicalblocknum, growing the window
+	bool rafill(INT64 logicalblocknum);
+	bool rahas(INT64 logicalblocknum) const { return logicalblocknum >= m_rafirst && logicalblocknum < m_rafirst + m_racount; }
+
 	CFTKBlockDevice*	m_dev;				// dev is a pointer to the device that stores the blocks for this file
-	RUNINFOLIST			m_runs;				// a list of block runs that define this stream
-	INT64				m_bc;				// blockcount: the number of blocks in the runlist
+	CRunList*			m_runlist;			// the (possibly shared) list of block runs that define this stream
+	int					m_firstrun;			// the first run in m_runlist used by this stream
+	int					m_runcount;			// the number of runs in m_runlist used by this stream
+	INT64				m_runbase;			// the logical block in m_runlist where this stream's block 0 lives
+	mutable int			m_lastrun;			// the index (in m_runlist) of the last run findrun() returned, -1 if none
+	INT64				m_bc;				// blockcount: the number of blocks in this stream
 	INT64				m_size;				// the size of the stream in bytes
     int					m_blocksize;		// from dev->blocksize()
 	int					m_initialoffset;	// the offset (in bytes) for the first block, to where the file really starts.
 											// this should be less than dev->ftkbioBlockSizeGet().
 	INT64				m_cp;				// cp is the current position in the file
+	EIOTag				m_iotag;			// what reads from this stream are for, see IOStats.h
+	EIOHint				m_iohint;
+
+	// readahead
+	int					m_raminbytes;		// the first window size, see SetReadAhead()
+	int					m_ramaxbytes;		// the largest window size, 0 if readahead is off
+	char*				m_rabuffer;			// malloc'd, holds m_racount blocks starting at m_rafirst
+	int					m_rabuffersize;		// the size of m_rabuffer in blocks
+	INT64				m_rafirst;
+	int					m_racount;
+	INT64				m_ranextpos;		// the physical position just after the last read, to spot sequential reads
+	SReadAheadStats		m_rastats;
 private:
 	typedef CStream inherited;
 	void				initfields();
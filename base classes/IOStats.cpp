@@ -0,0 +1,321 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+#include "IOStats.h"
+
+#include <windows.h>
+#include <string.h>
+
+namespace AccessData
+{
+
+static __declspec(thread) int t_iotag = iotagOTHER;
+static __declspec(thread) int t_iohint = iohintNONE;
+
+EIOTag IOTagGet()
+{
+	return (EIOTag)t_iotag;
+}
+
+EIOHint IOHintGet()
+{
+	return (EIOHint)t_iohint;
+}
+
+CIOTagScope::CIOTagScope(EIOTag tag, EIOHint hint)
+{
+	m_prevtag = (EIOTag)t_iotag;
+	m_prevhint = (EIOHint)t_iohint;
+	m_settag = tag != iotagOTHER;
+	m_sethint = hint != iohintNONE;
+	if ( m_settag ) t_iotag = tag;
+	if ( m_sethint ) t_iohint = hint;
+}
+
+CIOTagScope::~CIOTagScope()
+{
+	if ( m_settag ) t_iotag = m_prevtag;
+	if ( m_sethint ) t_iohint = m_prevhint;
+}
+
+INT64 IOTimestamp()
+{
+	static INT64 freq = 0;
+	LARGE_INTEGER li;
+	if ( freq == 0 )
+	{
+		QueryPerformanceFrequency(&li);
+		freq = li.QuadPart > 0 ? li.QuadPart : 1;
+	}
+	QueryPerformanceCounter(&li);
+
+	// split to keep the multiply from overflowing on long uptimes
+	return (li.QuadPart / freq) * 1000000 + ((li.QuadPart % freq) * 1000000) / freq;
+}
+
+#ifdef ADIO_IOSTATS
+
+void SIOCounters::clear()
+{
+	memset(this, 0, sizeof(*this));
+}
+
+void SIOCounters::add(const SIOCounters &rhs)
+{
+	reads += rhs.reads;
+	readns += rhs.readns;
+	blocks += rhs.blocks;
+	bytes += rhs.bytes;
+	seeks += rhs.seeks;
+	errors += rhs.errors;
+	microseconds += rhs.microseconds;
+	for(int i=0; i < LATENCYBUCKETS; i++) latency[i] += rhs.latency[i];
+}
+
+void SIOStats::clear()
+{
+	for(int i=0; i < iotagCOUNT; i++) tags[i].clear();
+}
+
+void SIOStats::add(const SIOStats &rhs)
+{
+	for(int i=0; i < iotagCOUNT; i++) tags[i].add(rhs.tags[i]);
+}
+
+SIOCounters SIOStats::total() const
+{
+	SIOCounters result;
+	result.clear();
+	for(int i=0; i < iotagCOUNT; i++) result.add(tags[i]);
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+
+void CIOStatsBlockDevice::initfields()
+{
+	m_dev = NULL;
+}
+
+void CIOStatsBlockDevice::clearfields()
+{
+	m_dev = NULL;
+}
+
+CIOStatsBlockDevice::CIOStatsBlockDevice()
+{
+	initfields();
+	m_tlsindex = TlsAlloc();
+	m_lock = new CRITICAL_SECTION;
+	InitializeCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+CIOStatsBlockDevice::~CIOStatsBlockDevice()
+{
+	clearfields();
+	for(unsigned int i=0; i < m_threadstats.size(); i++) delete m_threadstats[i];
+	m_threadstats.clear();
+	if ( m_tlsindex != TLS_OUT_OF_INDEXES ) TlsFree(m_tlsindex);
+	DeleteCriticalSection( (CRITICAL_SECTION *)m_lock );
+	delete (CRITICAL_SECTION *)m_lock;
+}
+
+bool CIOStatsBlockDevice::isvalid() const
+{
+	return m_dev != NULL && m_tlsindex != TLS_OUT_OF_INDEXES;
+}
+
+void CIOStatsBlockDevice::clear()
+{
+	clearfields();
+	resetstats();
+}
+
+bool CIOStatsBlockDevice::attach(CFTKBlockDevice *dev)
+{
+	clear();
+	if ( !dev || !dev->isvalid() ) return false;
+
+	m_dev = dev;
+	return true;
+}
+
+void CIOStatsBlockDevice::getstats(SIOStats &stats)
+{
+	stats.clear();
+
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+	for(unsigned int i=0; i < m_threadstats.size(); i++) stats.add( m_threadstats[i]->stats );
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+void CIOStatsBlockDevice::resetstats()
+{
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+	for(unsigned int i=0; i < m_threadstats.size(); i++)
+	{
+		m_threadstats[i]->stats.clear();
+		m_threadstats[i]->nextblock = -1;
+	}
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+CIOStatsBlockDevice::SThreadStats *CIOStatsBlockDevice::getthreadstats()
+{
+	SThreadStats *ts = (SThreadStats *)TlsGetValue(m_tlsindex);
+	if ( ts ) return ts;
+
+	// first read on this thread, give it its own counters
+	ts = new SThreadStats;
+	ts->stats.clear();
+	ts->nextblock = -1;
+
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+	m_threadstats.push_back(ts);
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+
+	TlsSetValue(m_tlsindex, ts);
+	return ts;
+}
+
+void CIOStatsBlockDevice::count(INT64 starttime, fssize_t blocknum, int blockcount, int bytes, bool ok)
+{
+	INT64 us = IOTimestamp() - starttime;
+
+	SThreadStats *ts = getthreadstats();
+	SIOCounters &c = ts->stats.tags[IOTagGet()];
+
+	c.reads++;
+	if ( !ok ) { c.errors++; return; }
+
+	if ( blocknum != ts->nextblock ) c.seeks++;
+	ts->nextblock = blocknum + blockcount;
+
+	c.blocks += blockcount;
+	c.bytes += bytes;
+	c.microseconds += us;
+
+	int bucket = 0;
+	for(INT64 x = us >> 1; x != 0 && bucket < SIOCounters::LATENCYBUCKETS-1; x >>= 1) bucket++;
+	c.latency[bucket]++;
+}
+
+//
+// CFTKBlockDevice methods
+//
+bool CIOStatsBlockDevice::ftkbioBlockRead(void *dest, fssize_t blocknum, int startoffset, int bytestoread)
+{
+	if ( !isvalid() ) return false;
+
+	INT64 starttime = IOTimestamp();
+	bool result = m_dev->ftkbioBlockRead(dest, blocknum, startoffset, bytestoread);
+	count(starttime, blocknum, 1, bytestoread < 0 ? m_dev->ftkbioBlockSize() : bytestoread, result);
+	return result;
+}
+
+int CIOStatsBlockDevice::ftkbioBlockReadN(void *dest, fssize_t startblocknum, int blockcount)
+{
+	if ( !isvalid() ) return -1;
+
+	INT64 starttime = IOTimestamp();
+	int result = m_dev->ftkbioBlockReadN(dest, startblocknum, blockcount);
+	count(starttime, startblocknum, result > 0 ? result : 0, result > 0 ? result * m_dev->ftkbioBlockSize() : 0, result >= 0);
+	getthreadstats()->stats.tags[IOTagGet()].readns++;
+	return result;
+}
+
+int CIOStatsBlockDevice::ftkbioBlockReadV(const SIOVec *iov, int iovcount, fssize_t startblocknum)
+{
+	if ( !isvalid() ) return -1;
+
+	INT64 starttime = IOTimestamp();
+	int result = m_dev->ftkbioBlockReadV(iov, iovcount, startblocknum);
+	count(starttime, startblocknum, result > 0 ? result : 0, result > 0 ? result * m_dev->ftkbioBlockSize() : 0, result >= 0);
+	getthreadstats()->stats.tags[IOTagGet()].readns++;
+	return result;
+}
+
+int CIOStatsBlockDevice::ftkbioBlockSize() const
+{
+	return isvalid() ? m_dev->ftkbioBlockSize() : FTKBIOERROR;
+}
+
+int CIOStatsBlockDevice::ftkbioPhysicalBlockSize() const
+{
+	return isvalid() ? m_dev->ftkbioPhysicalBlockSize() : FTKBIOERROR;
+}
+
+fssize_t CIOStatsBlockDevice::ftkbioFirstBlockNum() const
+{
+	return isvalid() ? m_dev->ftkbioFirstBlockNum() : FTKBIOERROR;
+}
+
+fssize_t CIOStatsBlockDevice::ftkbioBlockCount() const
+{
+	return isvalid() ? m_dev->ftkbioBlockCount() : FTKBIOERROR;
+}
+
+bool CIOStatsBlockDevice::ftkbioIsPhysicalDevice() const
+{
+	return isvalid() ? m_dev->ftkbioIsPhysicalDevice() : false;
+}
+
+fssize_t CIOStatsBlockDevice::ftkbioBlockNumTranslate(fssize_t blocknum, CFTKBlockDevice *dev) const
+{
+	if ( !isvalid() ) return FTKBIOERROR;
+	if ( dev == (CFTKBlockDevice*)this ) return blocknum;
+
+	return m_dev->ftkbioBlockNumTranslate(blocknum, dev);
+}
+
+CFTKBlockDevice::EVerifyResult CIOStatsBlockDevice::ftkbioVerify(CJobCallBack &callback)
+{
+	return isvalid() ? m_dev->ftkbioVerify(callback) : VERIFY_NOT_SUPPORTED;
+}
+
+bool CIOStatsBlockDevice::ftkbioVerifySupported()
+{
+	return isvalid() ? m_dev->ftkbioVerifySupported() : false;
+}
+
+void CIOStatsBlockDevice::ftkbioFlush()
+{
+	if ( m_dev ) m_dev->ftkbioFlush();
+}
+
+bool CIOStatsBlockDevice::ftkMetaDataListPopulate(CFTKMetaDataList &mdlist)
+{
+	return isvalid() ? m_dev->ftkMetaDataListPopulate(mdlist) : false;
+}
+
+#endif	// ADIO_IOSTATS
+
+};		// end namespace
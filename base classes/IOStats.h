@@ -0,0 +1,200 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+#ifndef IOSTATS_H
+#define IOSTATS_H
+
+#include "ADIOBlockDevice.h"
+#include <vector>
+
+// Define ADIO_IOSTATS to build the block device counters.  Without it the
+// counting device doesn't exist and nothing is counted.  The I/O tags are
+// always available since they cost next to nothing and are also used by
+// the read tracing.
+
+namespace AccessData
+{
+
+using std::vector;
+
+// EIOTag
+// What a read is for.  Set by the code that issues the read (usually via
+// CBlockStream::SetIOTag()) and picked up by whatever block device
+// decorators sit underneath.
+enum EIOTag
+{
+	iotagOTHER		= 0,
+	iotagMFT		= 1,
+	iotagBITMAP		= 2,
+	iotagINDEX		= 3,
+	iotagFILEDATA	= 4,
+	iotagCOUNT		= 5
+};
+
+// EIOHint
+// How the data being read is going to be used, so caches can decide whether it's
+// worth keeping.  Travels with the tag.
+enum EIOHint
+{
+	iohintNONE		= 0,
+	iohintMETADATA	= 1,			// read over and over, keep it
+	iohintRANDOM	= 2,			// no particular pattern
+	iohintBULK		= 3				// read once from start to end (hashing, copying), don't let it push anything out
+};
+
+// Returns the tag / hint for reads issued by the current thread
+EIOTag		IOTagGet();
+EIOHint		IOHintGet();
+
+// CIOTagScope
+// Tags all reads the current thread issues until it goes out of scope.
+// iotagOTHER and iohintNONE leave the current tag / hint alone so untagged
+// streams read on behalf of a tagged caller keep the caller's tag.
+class CIOTagScope
+{
+public:
+	CIOTagScope(EIOTag tag, EIOHint hint = iohintNONE);
+	~CIOTagScope();
+private:
+	EIOTag		m_prevtag;
+	EIOHint		m_prevhint;
+	bool		m_settag;
+	bool		m_sethint;
+
+	CIOTagScope(const CIOTagScope &rhs);				// disallow
+	CIOTagScope &operator=(const CIOTagScope &rhs);		// disallow
+};
+
+// Returns a timestamp in microseconds from an arbitrary starting point.
+// Only good for measuring intervals.
+INT64		IOTimestamp();
+
+#ifdef ADIO_IOSTATS
+
+// SIOCounters
+// Counters for one tag.  Latency is bucketed by powers of 2 microseconds,
+// ie. latency[0] is < 2us, latency[1] is 2..3us, latency[2] is 4..7us, etc.
+struct SIOCounters
+{
+	enum { LATENCYBUCKETS = 24 };
+
+	INT64	reads;					// calls to ftkbioBlockRead + ftkbioBlockReadN + ftkbioBlockReadV
+	INT64	readns;					// of those, the calls to ftkbioBlockReadN and ftkbioBlockReadV
+	INT64	blocks;					// blocks touched
+	INT64	bytes;					// bytes returned
+	INT64	seeks;					// reads that didn't start on the block after the previous read (per thread)
+	INT64	errors;					// reads that failed
+	INT64	microseconds;			// total time spent in the device
+	INT64	latency[LATENCYBUCKETS];
+
+	void	clear();
+	void	add(const SIOCounters &rhs);
+};
+
+// SIOStats
+// A full set of counters, one per tag.
+struct SIOStats
+{
+	SIOCounters		tags[iotagCOUNT];
+
+	void			clear();
+	void			add(const SIOStats &rhs);
+	SIOCounters		total() const;
+};
+
+// CIOStatsBlockDevice
+// A block device that passes everything through to another device and counts the reads.
+// Each thread counts into its own SIOStats, so counting doesn't need a lock.  getstats()
+// adds them all together.
+class CIOStatsBlockDevice : public CFTKBlockDevice
+{
+public:
+	CIOStatsBlockDevice();
+	~CIOStatsBlockDevice();
+
+	bool			isvalid() const;
+	void			clear();
+
+	// attach()
+	// Starts passing reads through to dev and resets the counters.  Doesn't take ownership of dev.
+	bool			attach(CFTKBlockDevice *dev);
+	CFTKBlockDevice* getdev() const		{ return m_dev; }
+
+	// Adds up the counters from all threads.  resetstats() isn't synchronized with
+	// threads that are in the middle of a read, so only call it while the device is idle.
+	void			getstats(SIOStats &stats);
+	void			resetstats();
+
+	//
+	// CFTKBlockDevice methods
+	//
+	bool			ftkbioBlockRead(void *dest, fssize_t blocknum, int startoffset=0, int bytestoread=-1);
+	int				ftkbioBlockReadN(void *dest, fssize_t startblocknum, int count);
+	int				ftkbioBlockReadV(const SIOVec *iov, int iovcount, fssize_t startblocknum);
+	int				ftkbioBlockSize() const;
+	int				ftkbioPhysicalBlockSize() const;
+	fssize_t		ftkbioFirstBlockNum() const;
+	fssize_t		ftkbioBlockCount() const;
+	bool			ftkbioIsPhysicalDevice() const;
+	fssize_t		ftkbioBlockNumTranslate(fssize_t blocknum, CFTKBlockDevice *dev) const;
+	EVerifyResult	ftkbioVerify(CJobCallBack &callback);
+	bool			ftkbioVerifySupported();
+	void			ftkbioFlush();
+
+	bool			ftkMetaDataListPopulate(CFTKMetaDataList &mdlist);
+protected:
+	struct SThreadStats
+	{
+		SIOStats	stats;
+		fssize_t	nextblock;			// the block after the end of this thread's last read
+	};
+
+	SThreadStats*	getthreadstats();
+	void			count(INT64 starttime, fssize_t blocknum, int blockcount, int bytes, bool ok);
+
+	CFTKBlockDevice*		m_dev;
+	unsigned long			m_tlsindex;			// TLS slot that holds this thread's SThreadStats
+	vector<SThreadStats*>	m_threadstats;		// every SThreadStats handed out, protected by m_lock.  Only freed by the dtor.
+	void*					m_lock;				// CRITICAL_SECTION, kept opaque to keep windows.h out of the header
+private:
+	void initfields();
+	void clearfields();
+
+	typedef CFTKBlockDevice inherited;
+	CIOStatsBlockDevice(const CIOStatsBlockDevice &rhs);				// disallow
+	CIOStatsBlockDevice &operator=(const CIOStatsBlockDevice &rhs);	// disallow
+};
+
+#endif	// ADIO_IOSTATS
+
+};		// end namespace
+
+#endif
@@ -0,0 +1,466 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "IOTrace.h"
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <list>
+#include <map>
+
+namespace AccessData
+{
+
+using std::list;
+using std::map;
+
+static const char TRACEMAGIC[8] = { 'A', 'D', 'I', 'O', 'T', 'R', 'C', '1' };
+
+struct STraceFileHeader
+{
+	char		magic[8];
+	INT32		blocksize;
+	INT32		count;
+};
+
+CIOTrace::CIOTrace()
+{
+	m_blocksize = 0;
+}
+
+void CIOTrace::clear()
+{
+	m_blocksize = 0;
+	m_records.clear();
+}
+
+bool CIOTrace::save(const char *filename) const
+{
+	if ( !isvalid() || !filename ) return false;
+
+	FILE *fout = fopen(filename, "wb");
+	if ( !fout ) return false;
+
+	STraceFileHeader hdr;
+	memcpy(hdr.magic, TRACEMAGIC, sizeof(hdr.magic));
+	hdr.blocksize = m_blocksize;
+	hdr.count = m_records.size();
+
+	bool result = fwrite(&hdr, sizeof(hdr), 1, fout) == 1;
+	if ( result && hdr.count > 0 ) result = fwrite(&m_records[0], sizeof(STraceRecord), hdr.count, fout) == (size_t)hdr.count;
+
+	if ( fclose(fout) != 0 ) result = false;
+	return result;
+}
+
+bool CIOTrace::load(const char *filename)
+{
+	clear();
+	if ( !filename ) return false;
+
+	FILE *fin = fopen(filename, "rb");
+	if ( !fin ) return false;
+
+	STraceFileHeader hdr;
+	bool result = fread(&hdr, sizeof(hdr), 1, fin) == 1
+		&& memcmp(hdr.magic, TRACEMAGIC, sizeof(hdr.magic)) == 0
+		&& hdr.blocksize > 0 && hdr.count >= 0;
+
+	if ( result && hdr.count > 0 )
+	{
+		m_records.resize(hdr.count);
+		result = fread(&m_records[0], sizeof(STraceRecord), hdr.count, fin) == (size_t)hdr.count;
+	}
+	fclose(fin);
+
+	if ( !result ) { clear(); return false; }
+
+	m_blocksize = hdr.blocksize;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void CIOTraceRecorder::initfields()
+{
+	m_starttime = 0;
+	m_maxrecords = -1;
+	m_dropped = 0;
+}
+
+void CIOTraceRecorder::clearfields()
+{
+	m_trace.clear();
+	m_starttime = 0;
+	m_maxrecords = -1;
+	m_dropped = 0;
+}
+
+CIOTraceRecorder::CIOTraceRecorder()
+{
+	initfields();
+	m_lock = new CRITICAL_SECTION;
+	InitializeCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+CIOTraceRecorder::~CIOTraceRecorder()
+{
+	clearfields();
+	DeleteCriticalSection( (CRITICAL_SECTION *)m_lock );
+	delete (CRITICAL_SECTION *)m_lock;
+}
+
+void CIOTraceRecorder::clear()
+{
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+	clearfields();
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+void CIOTraceRecorder::start(int blocksize, int maxrecords)
+{
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+	clearfields();
+	m_trace.setblocksize(blocksize);
+	m_maxrecords = maxrecords;
+	m_starttime = IOTimestamp();
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+void CIOTraceRecorder::gettrace(CIOTrace &trace, int *dropped)
+{
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+	trace = m_trace;
+	if ( dropped ) *dropped = m_dropped;
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+void CIOTraceRecorder::record(INT64 timestamp, fssize_t blocknum, int offset, int length, int blockcount, int flags)
+{
+	STraceRecord rec;
+	rec.blocknum = blocknum;
+	rec.offset = offset;
+	rec.length = length;
+	rec.blockcount = blockcount;
+	rec.tag = (UINT16)IOTagGet();
+	rec.flags = (UINT16)(flags | (IOHintGet() == iohintBULK ? STraceRecord::FLAG_BULK : 0));
+
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+	rec.timestamp = timestamp - m_starttime;
+	if ( m_maxrecords < 0 || m_trace.count() < m_maxrecords ) m_trace.add(rec);
+	else m_dropped++;
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+}
+
+//-----------------------------------------------------------------------------
+
+void CTraceBlockDevice::initfields()
+{
+	m_dev = NULL;
+}
+
+void CTraceBlockDevice::clearfields()
+{
+	m_dev = NULL;
+	m_recorder.clear();
+}
+
+CTraceBlockDevice::CTraceBlockDevice()
+{
+	initfields();
+}
+
+CTraceBlockDevice::~CTraceBlockDevice()
+{
+	clearfields();
+}
+
+bool CTraceBlockDevice::isvalid() const
+{
+	return m_dev != NULL;
+}
+
+void CTraceBlockDevice::clear()
+{
+	clearfields();
+}
+
+bool CTraceBlockDevice::attach(CFTKBlockDevice *dev, int maxrecords)
+{
+	clear();
+	if ( !dev || !dev->isvalid() ) return false;
+
+	m_dev = dev;
+	m_recorder.start( dev->ftkbioBlockSize(), maxrecords );
+	return true;
+}
+
+//
+// CFTKBlockDevice methods
+//
+bool CTraceBlockDevice::ftkbioBlockRead(void *dest, fssize_t blocknum, int startoffset, int bytestoread)
+{
+	if ( !isvalid() ) return false;
+
+	INT64 timestamp = IOTimestamp();
+	bool result = m_dev->ftkbioBlockRead(dest, blocknum, startoffset, bytestoread);
+	int length = bytestoread < 0 ? m_dev->ftkbioBlockSize() - startoffset : bytestoread;
+	m_recorder.record(timestamp, blocknum, startoffset, length, 1, result ? 0 : STraceRecord::FLAG_FAILED);
+	return result;
+}
+
+int CTraceBlockDevice::ftkbioBlockReadN(void *dest, fssize_t startblocknum, int blockcount)
+{
+	if ( !isvalid() ) return -1;
+
+	INT64 timestamp = IOTimestamp();
+	int result = m_dev->ftkbioBlockReadN(dest, startblocknum, blockcount);
+	int flags = STraceRecord::FLAG_READN | (result < 0 ? STraceRecord::FLAG_FAILED : 0);
+	m_recorder.record(timestamp, startblocknum, 0, blockcount * m_recorder.blocksize(), blockcount, flags);
+	return result;
+}
+
+int CTraceBlockDevice::ftkbioBlockReadV(const SIOVec *iov, int iovcount, fssize_t startblocknum)
+{
+	if ( !isvalid() ) return -1;
+
+	INT64 timestamp = IOTimestamp();
+	int result = m_dev->ftkbioBlockReadV(iov, iovcount, startblocknum);
+
+	int blockcount = 0;
+	for(int i = 0; i < iovcount; i++) blockcount += iov[i].length / m_recorder.blocksize();
+	int flags = STraceRecord::FLAG_READN | (result < 0 ? STraceRecord::FLAG_FAILED : 0);
+	m_recorder.record(timestamp, startblocknum, 0, blockcount * m_recorder.blocksize(), blockcount, flags);
+	return result;
+}
+
+int CTraceBlockDevice::ftkbioBlockSize() const
+{
+	return isvalid() ? m_dev->ftkbioBlockSize() : FTKBIOERROR;
+}
+
+int CTraceBlockDevice::ftkbioPhysicalBlockSize() const
+{
+	return isvalid() ? m_dev->ftkbioPhysicalBlockSize() : FTKBIOERROR;
+}
+
+fssize_t CTraceBlockDevice::ftkbioFirstBlockNum() const
+{
+	return isvalid() ? m_dev->ftkbioFirstBlockNum() : FTKBIOERROR;
+}
+
+fssize_t CTraceBlockDevice::ftkbioBlockCount() const
+{
+	return isvalid() ? m_dev->ftkbioBlockCount() : FTKBIOERROR;
+}
+
+bool CTraceBlockDevice::ftkbioIsPhysicalDevice() const
+{
+	return isvalid() ? m_dev->ftkbioIsPhysicalDevice() : false;
+}
+
+fssize_t CTraceBlockDevice::ftkbioBlockNumTranslate(fssize_t blocknum, CFTKBlockDevice *dev) const
+{
+	if ( !isvalid() ) return FTKBIOERROR;
+	if ( dev == (CFTKBlockDevice*)this ) return blocknum;
+
+	return m_dev->ftkbioBlockNumTranslate(blocknum, dev);
+}
+
+CFTKBlockDevice::EVerifyResult CTraceBlockDevice::ftkbioVerify(CJobCallBack &callback)
+{
+	return isvalid() ? m_dev->ftkbioVerify(callback) : VERIFY_NOT_SUPPORTED;
+}
+
+bool CTraceBlockDevice::ftkbioVerifySupported()
+{
+	return isvalid() ? m_dev->ftkbioVerifySupported() : false;
+}
+
+void CTraceBlockDevice::ftkbioFlush()
+{
+	if ( m_dev ) m_dev->ftkbioFlush();
+}
+
+bool CTraceBlockDevice::ftkMetaDataListPopulate(CFTKMetaDataList &mdlist)
+{
+	return isvalid() ? m_dev->ftkMetaDataListPopulate(mdlist) : false;
+}
+
+//-----------------------------------------------------------------------------
+
+SReplayPolicy::SReplayPolicy()
+{
+	cacheblocks = 0;
+	readaheadblocks = 0;
+	sequentialonly = true;
+	coalesce = true;
+	bulkbypass = false;
+	requestus = 100;			// roughly a spinning disk: 100us per command,
+	seekus = 8000;				// 8ms per seek
+	blockus = 5;				// and ~100MB/s for 512 byte blocks
+}
+
+void SReplayResult::clear()
+{
+	memset(this, 0, sizeof(*this));
+}
+
+// CReplayCache
+// The LRU block cache used by the replay.  Only tracks which blocks are present.
+class CReplayCache
+{
+public:
+	CReplayCache(int capacity) : m_capacity(capacity) {}
+
+	bool lookup(fssize_t blocknum)
+	{
+		map<fssize_t, list<fssize_t>::iterator>::iterator i = m_index.find(blocknum);
+		if ( i == m_index.end() ) return false;
+		m_lru.splice(m_lru.begin(), m_lru, i->second);
+		return true;
+	}
+
+	bool contains(fssize_t blocknum) const
+	{
+		return m_index.find(blocknum) != m_index.end();
+	}
+
+	void insert(fssize_t blocknum)
+	{
+		if ( m_capacity <= 0 || lookup(blocknum) ) return;
+
+		m_lru.push_front(blocknum);
+		m_index[blocknum] = m_lru.begin();
+		if ( (int)m_index.size() > m_capacity )
+		{
+			m_index.erase(m_lru.back());
+			m_lru.pop_back();
+		}
+	}
+private:
+	int												m_capacity;
+	list<fssize_t>									m_lru;			// most recently used at the front
+	map<fssize_t, list<fssize_t>::iterator>		m_index;
+};
+
+struct SReplayRead
+{
+	fssize_t	start;
+	int			count;
+};
+
+bool CTraceReplay::replay(const CIOTrace &trace, const SReplayPolicy &policy, SReplayResult &result, unsigned int tagmask)
+{
+	result.clear();
+	if ( !trace.isvalid() ) return false;
+
+	CReplayCache cache(policy.cacheblocks);
+	vector<SReplayRead> reads;
+	fssize_t lastrequestend = -1;
+	fssize_t lastdeviceend = -1;
+
+	for(int r = 0; r < trace.count(); r++)
+	{
+		const STraceRecord &rec = trace[r];
+		if ( rec.tag < 32 && (tagmask & (1u << rec.tag)) == 0 ) continue;
+
+		result.requests++;
+		result.requestbytes += rec.length;
+
+		fssize_t first = rec.blocknum;
+		int count = rec.blockcount > 0 ? rec.blockcount : 1;
+		bool bypass = policy.bulkbypass && (rec.flags & STraceRecord::FLAG_BULK) != 0;
+
+		// figure out which blocks have to come from the device
+		reads.clear();
+		for(fssize_t b = first; b < first + count; b++)
+		{
+			if ( bypass ? cache.contains(b) : cache.lookup(b) ) { result.blockhits++; continue; }
+
+			result.blockmisses++;
+			if ( policy.coalesce && !reads.empty() && reads.back().start + reads.back().count == b )
+			{
+				reads.back().count++;
+			} else
+			{
+				SReplayRead rd = { b, 1 };
+				reads.push_back(rd);
+			}
+		}
+
+		// readahead past the end of the request, up to the first block we already have
+		if ( !reads.empty() && policy.readaheadblocks > 0 && (!policy.sequentialonly || first == lastrequestend) )
+		{
+			fssize_t rastart = first + count;
+			int racount = 0;
+			while ( racount < policy.readaheadblocks && !cache.contains(rastart + racount) ) racount++;
+
+			if ( racount > 0 )
+			{
+				if ( policy.coalesce && reads.back().start + reads.back().count == rastart )
+				{
+					reads.back().count += racount;
+				} else
+				{
+					SReplayRead rd = { rastart, racount };
+					reads.push_back(rd);
+				}
+			}
+		}
+		lastrequestend = first + count;
+
+		// issue the device reads
+		for(unsigned int i = 0; i < reads.size(); i++)
+		{
+			const SReplayRead &rd = reads[i];
+
+			result.devicereads++;
+			result.deviceblocks += rd.count;
+			result.devicebytes += (INT64)rd.count * trace.blocksize();
+			result.simulatedus += policy.requestus + (INT64)rd.count * policy.blockus;
+			if ( rd.start != lastdeviceend )
+			{
+				result.seeks++;
+				result.simulatedus += policy.seekus;
+			}
+			lastdeviceend = rd.start + rd.count;
+
+			if ( !bypass ) for(int b = 0; b < rd.count; b++) cache.insert(rd.start + b);
+		}
+	}
+
+	return true;
+}
+
+};		// end namespace
@@ -0,0 +1,231 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef IOTRACE_H
+#define IOTRACE_H
+
+#include "ADIOBlockDevice.h"
+#include "IOStats.h"
+#include <vector>
+
+namespace AccessData
+{
+
+using std::vector;
+
+// STraceRecord
+// One read request as recorded by a CIOTraceRecorder.  The layout is also the
+// on-disk layout used by CIOTrace::save(), so don't rearrange it.
+struct STraceRecord
+{
+	enum { FLAG_READN = 1, FLAG_FAILED = 2, FLAG_BULK = 4 };		// FLAG_BULK: made with iohintBULK
+
+	INT64		blocknum;
+	INT64		timestamp;			// microseconds since recording started
+	INT32		offset;				// byte offset into the first block
+	INT32		length;				// bytes requested
+	INT32		blockcount;			// blocks covered by the request
+	UINT16		tag;				// EIOTag of the request
+	UINT16		flags;
+};
+
+// CIOTrace
+// A list of read requests, along with the block size of the device they were made against.
+class CIOTrace
+{
+public:
+	CIOTrace();
+
+	bool			isvalid() const					{ return m_blocksize > 0; }
+	void			clear();
+
+	void			setblocksize(int blocksize)		{ m_blocksize = blocksize; }
+	int				blocksize() const				{ return m_blocksize; }
+
+	void			add(const STraceRecord &rec)	{ m_records.push_back(rec); }
+	int				count() const					{ return m_records.size(); }
+	const STraceRecord&	operator[](int i) const		{ return m_records[i]; }
+
+	// save(), load()
+	// Writes / reads the trace to a file in a little endian binary format.
+	bool			save(const char *filename) const;
+	bool			load(const char *filename);
+protected:
+	int						m_blocksize;
+	vector<STraceRecord>	m_records;
+};
+
+// CIOTraceRecorder
+// Collects read requests into a CIOTrace.  Recording is serialized, so it is safe
+// to use from several threads but the records from different threads are
+// interleaved in arrival order.
+class CIOTraceRecorder
+{
+public:
+	CIOTraceRecorder();
+	~CIOTraceRecorder();
+
+	void			clear();
+
+	// start()
+	// Starts a new trace of requests made in blocksize byte blocks.
+	// Recording stops after maxrecords requests, -1 for no limit.
+	void			start(int blocksize, int maxrecords = -1);
+	int				blocksize() const		{ return m_trace.blocksize(); }
+
+	// record()
+	// Adds one request, tagged with the calling thread's EIOTag and EIOHint.
+	// timestamp is the IOTimestamp() taken when the request was issued.
+	void			record(INT64 timestamp, fssize_t blocknum, int offset, int length, int blockcount, int flags);
+
+	// Copies the trace recorded so far.  dropped is set to the number of requests
+	// that weren't recorded because of maxrecords.
+	void			gettrace(CIOTrace &trace, int *dropped = NULL);
+protected:
+	CIOTrace			m_trace;
+	INT64				m_starttime;
+	int					m_maxrecords;
+	int					m_dropped;
+	void*				m_lock;				// CRITICAL_SECTION, kept opaque to keep windows.h out of the header
+private:
+	void initfields();
+	void clearfields();
+
+	CIOTraceRecorder(const CIOTraceRecorder &rhs);				// disallow
+	CIOTraceRecorder &operator=(const CIOTraceRecorder &rhs);	// disallow
+};
+
+// CTraceBlockDevice
+// A block device that passes everything through to another device and records
+// every read request that reaches it.  Only what gets this far is recorded: under
+// a CNTFS that is the traffic left over after its cluster cache, and the requests
+// are already grown by any stream readahead.  To capture the access pattern of the
+// filesystem code itself, use CFSBase::settrace() instead.
+class CTraceBlockDevice : public CFTKBlockDevice
+{
+public:
+	CTraceBlockDevice();
+	~CTraceBlockDevice();
+
+	bool			isvalid() const;
+	void			clear();
+
+	// attach()
+	// Starts passing reads through to dev and starts a new trace.  Doesn't take ownership of dev.
+	// Recording stops after maxrecords requests, -1 for no limit.
+	bool			attach(CFTKBlockDevice *dev, int maxrecords = -1);
+	CFTKBlockDevice* getdev() const		{ return m_dev; }
+
+	// Copies the trace recorded so far.  dropped is set to the number of requests
+	// that weren't recorded because of maxrecords.
+	void			gettrace(CIOTrace &trace, int *dropped = NULL)	{ m_recorder.gettrace(trace, dropped); }
+
+	//
+	// CFTKBlockDevice methods
+	//
+	bool			ftkbioBlockRead(void *dest, fssize_t blocknum, int startoffset=0, int bytestoread=-1);
+	int				ftkbioBlockReadN(void *dest, fssize_t startblocknum, int count);
+	int				ftkbioBlockReadV(const SIOVec *iov, int iovcount, fssize_t startblocknum);
+	int				ftkbioBlockSize() const;
+	int				ftkbioPhysicalBlockSize() const;
+	fssize_t		ftkbioFirstBlockNum() const;
+	fssize_t		ftkbioBlockCount() const;
+	bool			ftkbioIsPhysicalDevice() const;
+	fssize_t		ftkbioBlockNumTranslate(fssize_t blocknum, CFTKBlockDevice *dev) const;
+	EVerifyResult	ftkbioVerify(CJobCallBack &callback);
+	bool			ftkbioVerifySupported();
+	void			ftkbioFlush();
+
+	bool			ftkMetaDataListPopulate(CFTKMetaDataList &mdlist);
+protected:
+	CFTKBlockDevice*	m_dev;
+	CIOTraceRecorder	m_recorder;
+private:
+	void initfields();
+	void clearfields();
+
+	typedef CFTKBlockDevice inherited;
+	CTraceBlockDevice(const CTraceBlockDevice &rhs);				// disallow
+	CTraceBlockDevice &operator=(const CTraceBlockDevice &rhs);		// disallow
+};
+
+// SReplayPolicy
+// The I/O policy a CTraceReplay simulates, along with a simple latency model:
+// every device read costs requestus, plus seekus when it doesn't start where the
+// previous device read ended, plus blockus for every block transferred.
+struct SReplayPolicy
+{
+	int			cacheblocks;			// LRU block cache size, 0 for no cache
+	int			readaheadblocks;		// extra blocks read past a request that misses the cache
+	bool		sequentialonly;			// only read ahead when a request starts where the previous one ended
+	bool		coalesce;				// merge adjacent missing blocks into one device read
+	bool		bulkbypass;				// bulk requests use cached blocks but never add to or reorder the cache
+	int			requestus;
+	int			seekus;
+	int			blockus;
+
+	SReplayPolicy();
+};
+
+// SReplayResult
+// What a replayed trace would have cost under a policy.
+struct SReplayResult
+{
+	INT64		requests;				// requests in the trace
+	INT64		requestbytes;			// bytes the requests asked for
+	INT64		blockhits;				// requested blocks served from the cache
+	INT64		blockmisses;			// requested blocks that had to go to the device
+	INT64		devicereads;			// reads issued to the device
+	INT64		deviceblocks;			// blocks read from the device, including readahead
+	INT64		devicebytes;
+	INT64		seeks;					// device reads that didn't start where the last one ended
+	INT64		simulatedus;			// total device time according to the latency model
+
+	void		clear();
+};
+
+// CTraceReplay
+// Feeds a recorded trace through a simulated cache / readahead / coalescing policy
+// and reports the device traffic it would have caused.  Nothing is actually read,
+// so the original image isn't needed.
+class CTraceReplay
+{
+public:
+	// replay()
+	// Runs the whole trace through policy.  Only requests whose tag bit is set in
+	// tagmask are replayed (bit n is EIOTag n).  Returns false if the trace is invalid.
+	static bool		replay(const CIOTrace &trace, const SReplayPolicy &policy, SReplayResult &result, unsigned int tagmask = ~0u);
+};
+
+};		// end namespace
+
+#endif
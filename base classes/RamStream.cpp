@@ -130,6 +130,21 @@ int CRamBlockStream::Read(void *dest, int bytestoread, INT64 pos)
 	return bytestoread;
 }
 
+int CRamBlockStream::ReadV(const SIOVec *iov, int count, INT64 pos)
+{
+	// the data is already in memory, so CBlockStream's trip to the device doesn't apply
+	return CStream::ReadV(iov, count, pos);
+}
+
+bool CRamBlockStream::NextDataRange(INT64 pos, INT64 &datapos, INT64 &datalength) const
+{
+	// it's all in memory, there aren't any holes
+	if ( !isvalid() || pos >= m_buffersize ) return false;
+	datapos = pos < 0 ? 0 : pos;
+	datalength = m_buffersize - datapos;
+	return true;
+}
+
 fssize_t CRamBlockStream::PhysicalLength() const
 {
 	return m_buffersize;
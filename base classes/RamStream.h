@@ -55,6 +55,8 @@ public:
 	CStream*		Dup() const;
 	int				Read(void *dest, int bytestoread, INT64 pos);
     using CBlockStream::Read;
+	bool			NextDataRange(INT64 pos, INT64 &datapos, INT64 &datalength) const;
+	int				ReadV(const SIOVec *iov, int count, INT64 pos);
 	INT64			PhysicalLength() const;
 protected:
 	void			initfields();
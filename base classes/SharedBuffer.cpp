@@ -0,0 +1,63 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+#include "SharedBuffer.h"
+
+#include <windows.h>
+#include <stdlib.h>
+
+namespace AccessData
+{
+
+CSharedBuffer *CSharedBuffer::Create(int size)
+{
+	if ( size < 0 ) return NULL;
+
+	CSharedBuffer *temp = (CSharedBuffer *)malloc( sizeof(CSharedBuffer) + size );
+	if ( !temp ) return NULL;
+
+	temp->m_refcount = 1;
+	temp->m_size = size;
+	return temp;
+}
+
+CSharedBuffer *CSharedBuffer::AddRef()
+{
+	InterlockedIncrement( (long *)&m_refcount );
+	return this;
+}
+
+void CSharedBuffer::Release()
+{
+	if ( InterlockedDecrement( (long *)&m_refcount ) == 0 ) free(this);
+}
+
+};		// end namespace
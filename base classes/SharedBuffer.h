@@ -0,0 +1,72 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+#ifndef SHAREDBUFFER_H
+#define SHAREDBUFFER_H
+
+namespace AccessData
+{
+
+// CSharedBuffer
+// A reference counted block of memory.  The data lives in the same allocation
+// as the header, so creating one costs a single malloc.
+// Create() returns an instance with a reference count of 1.  Every AddRef()
+// must be balanced with a Release(); the last Release() frees the memory.
+// The counting is interlocked so instances can be shared between threads,
+// but the contents are not protected.  Treat the data as readonly once it
+// has been handed to a second owner.
+class CSharedBuffer
+{
+public:
+	static CSharedBuffer*	Create(int size);
+
+	CSharedBuffer*			AddRef();
+	void					Release();
+
+	char*					data()				{ return (char *)(this+1); }
+	const char*				data() const		{ return (const char *)(this+1); }
+	int						size() const		{ return m_size; }
+
+	// Returns true if ptr points somewhere inside of data()
+	bool					contains(const void *ptr) const	{ return data() <= (const char *)ptr && (const char *)ptr < data()+m_size; }
+private:
+	volatile long			m_refcount;
+	int						m_size;
+
+	CSharedBuffer();										// disallow, use Create()
+	~CSharedBuffer();										// disallow, use Release()
+	CSharedBuffer(const CSharedBuffer &rhs);				// disallow
+	CSharedBuffer &operator=(const CSharedBuffer &rhs);		// disallow
+};
+
+};		// end namespace
+
+#endif
@@ -0,0 +1,155 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+#include "ViewStream.h"
+#include <string.h>
+
+namespace AccessData
+{
+
+void CViewBlockStream::initfields()
+{
+	m_view = NULL;
+	m_viewoffset = 0;
+	m_viewlength = 0;
+}
+
+void CViewBlockStream::clearfields()
+{
+	if ( m_view ) m_view->Release();
+	m_view = NULL;
+	m_viewoffset = 0;
+	m_viewlength = 0;
+}
+
+void CViewBlockStream::assignfields(const CViewBlockStream &rhs)
+{
+	m_view = rhs.m_view ? rhs.m_view->AddRef() : NULL;
+	m_viewoffset = rhs.m_viewoffset;
+	m_viewlength = rhs.m_viewlength;
+}
+
+CViewBlockStream::CViewBlockStream()
+{
+	initfields();
+}
+
+CViewBlockStream::CViewBlockStream(const CViewBlockStream &rhs) : inherited(rhs)
+{
+	initfields();
+	assignfields(rhs);
+}
+
+CViewBlockStream::~CViewBlockStream()
+{
+	clearfields();
+}
+
+bool CViewBlockStream::isvalid() const
+{
+	return m_view != NULL;
+}
+
+void CViewBlockStream::clear()
+{
+	inherited::clear();
+	clearfields();
+}
+
+void CViewBlockStream::assign(const CViewBlockStream &rhs)
+{
+	inherited::assign(rhs);
+	clearfields();
+	assignfields(rhs);
+}
+
+CViewBlockStream &CViewBlockStream::operator=(const CViewBlockStream &rhs)
+{
+	assign(rhs);
+	return *this;
+}
+
+bool CViewBlockStream::setview(CSharedBuffer *buffer, int offset, int length)
+{
+	clearfields();
+	if ( !buffer || offset < 0 || length < 0 || offset+length > buffer->size() ) return false;
+
+	m_view = buffer->AddRef();
+	m_viewoffset = offset;
+	m_viewlength = length;
+
+	m_size = length;
+	return true;
+}
+
+const void *CViewBlockStream::GetBuffer() const
+{
+	return isvalid() ? m_view->data()+m_viewoffset : NULL;
+}
+
+//
+// CStream inherited
+//
+CStream *CViewBlockStream::Dup() const
+{
+	return new CViewBlockStream(*this);
+}
+
+int CViewBlockStream::Read(void *dest, int bytestoread, INT64 pos)
+{
+	if ( !isvalid() || !dest ) return -1;
+	if ( pos < 0 || pos >= m_viewlength ) return 0;
+	if ( pos+bytestoread > m_viewlength ) bytestoread = m_viewlength - (int)pos;
+	memcpy(dest, m_view->data()+m_viewoffset+(int)pos, bytestoread);
+	return bytestoread;
+}
+
+int CViewBlockStream::ReadV(const SIOVec *iov, int count, INT64 pos)
+{
+	// the data is already in memory, so CBlockStream's trip to the device doesn't apply
+	return CStream::ReadV(iov, count, pos);
+}
+
+bool CViewBlockStream::NextDataRange(INT64 pos, INT64 &datapos, INT64 &datalength) const
+{
+	// it's all in memory, there aren't any holes
+	if ( !isvalid() || pos >= m_viewlength ) return false;
+	datapos = pos < 0 ? 0 : pos;
+	datalength = m_viewlength - datapos;
+	return true;
+}
+
+INT64 CViewBlockStream::PhysicalLength() const
+{
+	return m_viewlength;
+}
+
+};		// end namespace
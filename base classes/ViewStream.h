@@ -0,0 +1,95 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+#ifndef VIEWSTREAM_H
+#define VIEWSTREAM_H
+
+#include "BlockStream.h"
+#include "SharedBuffer.h"
+
+namespace AccessData
+{
+
+// CViewBlockStream
+// A readonly stream over a range of bytes in a CSharedBuffer.  Unlike
+// CRamBlockStream, the bytes are not copied; the stream holds a reference to
+// the buffer, and Dup() just adds another reference.
+// The runs (if any are added) are only used to answer GetBlock() questions
+// about where the data lives on the device.  Reads never touch the device.
+class CViewBlockStream : public CBlockStream
+{
+public:
+	CViewBlockStream();
+	CViewBlockStream(const CViewBlockStream &rhs);
+	~CViewBlockStream();
+	CViewBlockStream &operator=(const CViewBlockStream &rhs);
+
+	bool			isvalid() const;
+	void			clear();
+
+	// setview()
+	// Points the stream at length bytes starting at offset in buffer.
+	// Takes a reference on buffer, the caller keeps its own reference.
+	bool			setview(CSharedBuffer *buffer, int offset, int length);
+
+	// GetBuffer()
+	// Returns a borrowed pointer to the first byte of the stream's data.
+	// The pointer stays valid for as long as this stream instance (or any Dup()
+	// of it) is alive, regardless of what happens to the object that created
+	// the stream.  Do not free it, and do not write to it.
+	const void*		GetBuffer() const;
+
+	//
+	// CBlockStream inherited
+	//
+	CStream*		Dup() const;
+	int				Read(void *dest, int bytestoread, INT64 pos);
+	using CBlockStream::Read;
+	bool			NextDataRange(INT64 pos, INT64 &datapos, INT64 &datalength) const;
+	int				ReadV(const SIOVec *iov, int count, INT64 pos);
+	INT64			PhysicalLength() const;
+protected:
+	void			initfields();
+	void			clearfields();
+	void			assignfields(const CViewBlockStream &rhs);
+	void			assign(const CViewBlockStream &rhs);
+
+	CSharedBuffer*	m_view;
+	int				m_viewoffset;
+	int				m_viewlength;
+private:
+	typedef CBlockStream inherited;
+};
+
+};		// end namespace
+
+
+#endif
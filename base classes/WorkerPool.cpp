@@ -0,0 +1,180 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#include "WorkerPool.h"
+
+#include <windows.h>
+
+namespace AccessData
+{
+
+#define WORKERPOOL_MAXTHREADS	64
+
+CWorkerPool::CWorkerPool()
+{
+	m_threads = NULL;
+	m_threadcount = 0;
+	m_outstanding = 0;
+
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection(cs);
+	m_lock = cs;
+	m_queued = NULL;
+	m_slots = NULL;
+	m_idle = CreateEvent(NULL, TRUE, TRUE, NULL);
+}
+
+CWorkerPool::~CWorkerPool()
+{
+	stop();
+	CloseHandle( (HANDLE)m_idle );
+
+	CRITICAL_SECTION *cs = (CRITICAL_SECTION *)m_lock;
+	DeleteCriticalSection(cs);
+	delete cs;
+}
+
+bool CWorkerPool::start(int threads, int maxpending)
+{
+	stop();
+
+	if ( threads < 0 )
+	{
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		threads = si.dwNumberOfProcessors;
+	}
+	if ( threads > WORKERPOOL_MAXTHREADS ) threads = WORKERPOOL_MAXTHREADS;
+	if ( threads <= 0 ) return true;
+	if ( maxpending < 1 ) maxpending = 1;
+
+	m_queued = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+	m_slots = CreateSemaphore(NULL, maxpending, maxpending, NULL);
+	m_threads = new void*[threads];
+	if ( !m_queued || !m_slots || !m_threads ) { stop(); return false; }
+
+	for(int i = 0; i < threads; i++)
+	{
+		DWORD threadid;
+		HANDLE h = CreateThread(NULL, 0, threadproc, this, 0, &threadid);
+		if ( !h ) break;
+		m_threads[m_threadcount++] = h;
+	}
+
+	// without any threads, submit() runs the tasks itself
+	if ( m_threadcount == 0 ) { stop(); return false; }
+	return true;
+}
+
+void CWorkerPool::stop()
+{
+	if ( m_threadcount > 0 )
+	{
+		// one NULL task per thread, after whatever is already queued
+		for(int i = 0; i < m_threadcount; i++)
+		{
+			WaitForSingleObject( (HANDLE)m_slots, INFINITE );
+			EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+			m_queue.push_back(NULL);
+			LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+			ReleaseSemaphore( (HANDLE)m_queued, 1, NULL );
+		}
+		WaitForMultipleObjects(m_threadcount, (const HANDLE *)m_threads, TRUE, INFINITE);
+		for(int i = 0; i < m_threadcount; i++) CloseHandle( (HANDLE)m_threads[i] );
+	}
+	delete[] m_threads;
+	m_threads = NULL;
+	m_threadcount = 0;
+
+	if ( m_queued ) CloseHandle( (HANDLE)m_queued );
+	if ( m_slots ) CloseHandle( (HANDLE)m_slots );
+	m_queued = NULL;
+	m_slots = NULL;
+	m_queue.clear();
+}
+
+void CWorkerPool::submit(CWorkerTask *task)
+{
+	if ( !task ) return;
+
+	if ( m_threadcount == 0 )
+	{
+		task->run();
+		delete task;
+		return;
+	}
+
+	WaitForSingleObject( (HANDLE)m_slots, INFINITE );
+
+	EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+	if ( m_outstanding++ == 0 ) ResetEvent( (HANDLE)m_idle );
+	m_queue.push_back(task);
+	LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+
+	ReleaseSemaphore( (HANDLE)m_queued, 1, NULL );
+}
+
+void CWorkerPool::wait()
+{
+	if ( m_threadcount > 0 ) WaitForSingleObject( (HANDLE)m_idle, INFINITE );
+}
+
+unsigned long __stdcall CWorkerPool::threadproc(void *param)
+{
+	((CWorkerPool *)param)->runtasks();
+	return 0;
+}
+
+void CWorkerPool::runtasks()
+{
+	for(;;)
+	{
+		WaitForSingleObject( (HANDLE)m_queued, INFINITE );
+
+		EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+		CWorkerTask *task = m_queue.front();
+		m_queue.pop_front();
+		LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+
+		ReleaseSemaphore( (HANDLE)m_slots, 1, NULL );
+		if ( !task ) break;
+
+		task->run();
+		delete task;
+
+		EnterCriticalSection( (CRITICAL_SECTION *)m_lock );
+		if ( --m_outstanding == 0 ) SetEvent( (HANDLE)m_idle );
+		LeaveCriticalSection( (CRITICAL_SECTION *)m_lock );
+	}
+}
+
+}		// end namespace AccessData
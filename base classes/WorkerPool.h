@@ -0,0 +1,88 @@
+/*
+	FILE NAME:
+
+	FILE DESCRIPTION:
+
+	CREDITS:
+
+	--------------------------------------------------------------------------
+	Copyright 2002, 2003 Trevor Harrison
+
+	* This file is licensed under the GPL.  See LICENSE.TXT for details.
+	* This file was given to Trevor Harrison by AccessData
+	(www.accessdata.com) so that it could be released to the public under
+	the GPL.  See ADLICENSE.TXT for details.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+*/
+
+
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <deque>
+
+namespace AccessData
+{
+
+// CWorkerTask
+// A piece of work for CWorkerPool.  The pool deletes it after run() returns.
+class CWorkerTask
+{
+public:
+	virtual ~CWorkerTask() { }
+	virtual void	run() = 0;
+};
+
+// CWorkerPool
+// A fixed set of threads that run CWorkerTasks.  Meant for CPU work that can be split up,
+// with the I/O staying on the thread that calls submit().  submit() blocks while maxpending
+// tasks are waiting to be picked up, so a fast reader can't run far ahead of the workers.
+// With 0 threads (or if they can't be started), submit() just runs the task itself.
+class CWorkerPool
+{
+public:
+	CWorkerPool();
+	~CWorkerPool();
+
+	// start()
+	// Starts the threads.  threads < 0 means one per processor.
+	bool			start(int threads = -1, int maxpending = 16);
+	void			stop();					// waits for the queued tasks, then ends the threads
+	int				threadcount() const		{ return m_threadcount; }
+
+	void			submit(CWorkerTask *task);
+	void			wait();					// returns once every submitted task has finished
+protected:
+	static unsigned long __stdcall threadproc(void *param);
+	void			runtasks();
+
+	void**					m_threads;		// HANDLEs
+	int						m_threadcount;
+	void*					m_lock;			// CRITICAL_SECTION, guards m_queue and m_outstanding
+	void*					m_queued;		// semaphore, counts m_queue
+	void*					m_slots;		// semaphore, counts the room left in m_queue
+	void*					m_idle;			// manual reset event, set while m_outstanding is 0
+	std::deque<CWorkerTask*>	m_queue;		// a NULL task tells a thread to end
+	int						m_outstanding;	// submitted but not finished
+private:
+	CWorkerPool(const CWorkerPool &rhs);				// disallow
+	CWorkerPool &operator=(const CWorkerPool &rhs);		// disallow
+};
+
+}		// end namespace AccessData
+
+#endif